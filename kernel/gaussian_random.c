@@ -5,9 +5,15 @@
 #include <linux/types.h>
 #include <linux/math64.h>
 #include "gaussian_random.h"
+#include "gaussian_table.h"
 
 #define CLT_N 12
 
+//Bits of one draw: sign, table index and interpolation fraction
+#define ICDF_FRAC_BITS (31 - GAUSSIAN_ICDF_BITS)
+#define ICDF_INDEX_MASK ((1U << GAUSSIAN_ICDF_BITS) - 1)
+#define ICDF_FRAC_MASK ((1U << ICDF_FRAC_BITS) - 1)
+
 
 __s32 gaussian_s32_clt(__s32 mean, __s32 stddev)
 {
@@ -35,6 +41,91 @@ __s32 gaussian_s32_clt(__s32 mean, __s32 stddev)
 
 EXPORT_SYMBOL(gaussian_s32_clt);
 
+//Inverse CDF lookup: one draw, a linear interpolation and no division
+static __s32 icdf_draw(u32 draw, __s32 mean, __s32 stddev)
+{
+	u32 idx = (draw >> ICDF_FRAC_BITS) & ICDF_INDEX_MASK;
+	u32 frac = draw & ICDF_FRAC_MASK;
+	const u32 *table = gaussian_icdf_q16;
+	s64 x;
+	
+	//The last bin is the tail, look it up again in its own table with the fraction bits
+	if(idx == ICDF_INDEX_MASK)
+	{
+		idx = frac >> (ICDF_FRAC_BITS - GAUSSIAN_TAIL_BITS);
+		frac = (frac << GAUSSIAN_TAIL_BITS) & ICDF_FRAC_MASK;
+		table = gaussian_tail_q16;
+	}
+	
+	//Standard normal in Q16, the tables hold the upper half only
+	x = table[idx] + ((((s64)table[idx + 1] - table[idx]) * frac) >> ICDF_FRAC_BITS);
+	if(draw & (1U << 31))
+	{
+		x = -x;
+	}
+	
+	return mean + (__s32)((x * stddev) >> 16);
+}
+
+__s32 gaussian_s32_icdf(__s32 mean, __s32 stddev)
+{
+	return icdf_draw(prandom_u32(), mean, stddev);
+}
+
+EXPORT_SYMBOL(gaussian_s32_icdf);
+
+static inline u32 rng_rotl(u32 x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+//splitmix64 expands the seed, consecutive outputs are never both zero so the state never is
+void gaussian_rng_seed(struct gaussian_rng *rng, __u64 seed)
+{
+	u64 z;
+	int i;
+	
+	for(i = 0; i < 4; i += 2)
+	{
+		seed += 0x9e3779b97f4a7c15ULL;
+		z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		rng->s[i] = (u32)z;
+		rng->s[i + 1] = (u32)(z >> 32);
+	}
+}
+
+EXPORT_SYMBOL(gaussian_rng_seed);
+
+//xoshiro128** 1.1, 32-bit operations only, period 2^128 - 1
+__u32 gaussian_rng_u32(struct gaussian_rng *rng)
+{
+	u32 *s = rng->s;
+	u32 result = rng_rotl(s[1] * 5, 7) * 9;
+	u32 t = s[1] << 9;
+	
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rng_rotl(s[3], 11);
+	
+	return result;
+}
+
+EXPORT_SYMBOL(gaussian_rng_u32);
+
+//Same transform as gaussian_s32_icdf(), one draw of the given state per sample
+__s32 gaussian_s32_icdf_rng(struct gaussian_rng *rng, __s32 mean, __s32 stddev)
+{
+	return icdf_draw(gaussian_rng_u32(rng), mean, stddev);
+}
+
+EXPORT_SYMBOL(gaussian_s32_icdf_rng);
+
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("LASEC TECHNNOLOGIES");
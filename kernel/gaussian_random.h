@@ -3,6 +3,16 @@
 
 #include <linux/types.h>
 
+//xoshiro128** state, one per instance so that a seed fixes its sample stream
+struct gaussian_rng {
+	__u32 s[4];
+};
+
 __s32 gaussian_s32_clt(__s32 mean, __s32 stddev);
+__s32 gaussian_s32_icdf(__s32 mean, __s32 stddev);
+
+void gaussian_rng_seed(struct gaussian_rng *rng, __u64 seed);
+__u32 gaussian_rng_u32(struct gaussian_rng *rng);
+__s32 gaussian_s32_icdf_rng(struct gaussian_rng *rng, __s32 mean, __s32 stddev);
 
 #endif
@@ -3,7 +3,6 @@
 #include <linux/module.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
-#include <linux/kfifo.h>
 #include <linux/poll.h>
 #include <linux/kdev_t.h>
 #include <linux/fs.h>
@@ -21,64 +20,278 @@
 #include <linux/property.h>
 #include <linux/platform_device.h>
 #include <linux/of_device.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/log2.h>
+#include <linux/rcupdate.h>
+#include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/seqlock.h>
+#include <linux/rculist.h>
+#include <linux/idr.h>
+#include <linux/cpumask.h>
+#include <linux/smp.h>
+#include <linux/of.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/kthread.h>
+#include <linux/kfifo.h>
+#include <linux/sched.h>
+#include <linux/random.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
+#include <linux/sched/types.h>
+#endif
 
 #include "gaussian_random.h"
 #include "simtemp.h"
 
-//Temperature generation modes
-#define MODE_NRM 0
-#define MODE_NSY 1
-#define MODE_RMP 2
+#define CREATE_TRACE_POINTS
+#include "simtemp_trace.h"
+
+//Sample generation contexts
+#define CTX_HARDIRQ 0
+#define CTX_SOFTIRQ 1
+#define CTX_THREAD 2
+
+//Expiries queued for the generation thread, a power of two
+#define TICK_QUEUE 16
 
-//Ring buffer size
+//History ring size in samples, rounded up to a power of two
 #define FIFO_SIZE 256
+#define FIFO_SIZE_MIN 16
+#define FIFO_SIZE_MAX (1 << 20) // 16 MiB of samples
+
+//Samples copied per RCU section in read()
+#define READ_CHUNK 256
+
+//SIMTEMP_FMT_DELTA: largest encoding of one sample (timestamp 10, flags 5 and temperature 3 bytes), one frame per chunk
+#define FRAME_SAMPLE_MAX 18
+#define FRAME_BYTES ALIGN(sizeof(struct simtemp_frame) + (READ_CHUNK - 1) * FRAME_SAMPLE_MAX, 8)
+
+//Wakeup coalescing limits, in samples
+#define WAKE_SAMPLES_MAX FIFO_SIZE_MAX
+
+//Aggregation windows, sum_sq of the largest window fits in 64 bits
+#define WINDOW_SAMPLES_DEFAULT 1000
+#define WINDOW_SAMPLES_MAX (1 << 24)
+#define AGG_QUEUE 64 // closed windows per reader, a power of two
+
+//Alert edges queued per reader, a power of two
+#define EVENT_QUEUE 16
+
+//mmap ring size: control page plus data pages
+#define RING_BYTES ((1 + SIMTEMP_RING_PAGES) * PAGE_SIZE)
+
+//Instances, one minor and one sysfs directory each
+#define SIMTEMP_MAX_DEVICES 64
+
+//Configuration of an instance without DT properties
+#define SAMPLING_us_DEFAULT 150000 //150 ms
+#define THRESHOLD_mC_DEFAULT 20000 //20 °C
 
 //Temperature simulation
 #define TEMP_MEAN_mC 20000
 #define TEMP_MAX 100000
 #define TEMP_MIN -50000
+#define HYSTERESIS_MAX_mC (TEMP_MAX - TEMP_MIN)
 
 //Sampling range 
-#define TIME_MIN_us 50 // 20 KHz
+#define TIME_MIN_us 1 // 1 MHz, batched
 #define TIME_MAX_us 10000000 // 10s
 
+//Timer tick, faster sampling generates several samples per expiry
+#define TICK_us_DEFAULT 50 // 20 KHz
+#define TICK_MIN_us 10
+#define TICK_MAX_us 10000
+#define BATCH_MAX 1024 // samples per expiry
+
 //Events flags
 #define FLAG_NEW_SAMPLE (1<<0)
 #define FLAG_THRESHOLD_CROSSED (1<<1)
 
 //Temperature modes names
-const char * modes[] ={"normal","noisy","ramp"};
+const char * modes[] ={"normal","noisy","ramp","replay"};
+
+//Generation contexts names
+const char * contexts[] ={"hardirq","softirq","thread"};
+
+//Module parameters, applied to every instance
+static __u32 fifo_size = FIFO_SIZE;
+static unsigned int nr_devices = 1;
+
+module_param(fifo_size, uint, 0444);
+MODULE_PARM_DESC(fifo_size, "History ring depth in samples (power of two, 16 to 1048576)");
+module_param(nr_devices, uint, 0444);
+MODULE_PARM_DESC(nr_devices, "Instances created when the DT has no enabled nxp,simtemp node (1 to 64)");
 
-//Kernel space variables
-static __u32 sampling_us = 150000; //150 ms
-static __s32 threshold_mC = 20000; //20 °C
-static __u8 mode = MODE_RMP;
-static __u32 TEMP_STD_mC = 100; // Temperature standard deviation 0.1 °C
+//History ring, swapped as a whole on resize
+struct hist_ring {
+	u32 size;	//power of two
+	struct simtemp_sample buf[];
+};
+
+//Log2 histogram of a timer metric, bucket b counts the values of fls64(ns) == b
+#define TIMER_HIST_BUCKETS 65
+
+struct timer_hist {
+	u64 bucket[TIMER_HIST_BUCKETS];
+	u64 count;
+	u64 min_ns;
+	u64 max_ns;
+};
+
+//Sample and alert counters, per CPU so the timer never shares a lock with readers
+struct simtemp_pcpu_stats {
+	u64 counter;
+	u64 alert;
+	struct u64_stats_sync syncp;
+};
+
+//Runtime configuration, never modified once published, writers swap in a new copy
+struct simtemp_cfg {
+	u32 sampling_us;
+	s32 threshold_mC;
+	u32 hysteresis_mC;	//alerts clear at threshold_mC - hysteresis_mC
+	u8 mode;
+	u32 TEMP_STD_mC;	//temperature standard deviation
+	u32 tick_us;		//shortest timer period
+	u32 batch;		//samples per timer expiry
+	ktime_t kt_period;
+	bool phase_lock;	//expire on multiples of the period instead of relative to the last expiry
+	u8 context;		//CTX_*, where samples are generated
+	u64 seed;		//PRNG seed of the normal and noisy modes
+	u64 seed_gen;		//bumped by every seed write, the producer reseeds when it changes
+	struct rcu_head rcu;
+};
 
-//Statically allocated FIFO and waitqueue
-static DEFINE_KFIFO(CBuffer,struct simtemp_sample,FIFO_SIZE);
-static DECLARE_WAIT_QUEUE_HEAD(wq);
+//Waveform of MODE_RPL, replaced as a whole by write()
+struct wave_table {
+	u64 gen;		//upload number, playback restarts when it changes
+	u32 count;
+	u32 flags;		//SIMTEMP_WAVE_*
+	s32 temp_mC[];
+};
 
-//Define mutexes
-static DEFINE_MUTEX(sampling_us_lock);
-static DEFINE_MUTEX(threshold_mC_lock);
-static DEFINE_MUTEX(mode_lock);
+//Expiry handed from the hard interrupt to the generation thread
+struct simtemp_tick {
+	u64 expires_ns;
+	u64 real_ns;		//timestamp of the newest sample
+};
 
-//Define spinlock
-static DEFINE_SPINLOCK(fifo_lock);
-static DEFINE_SPINLOCK(flags_lock);
+//Per instance state, one per nxp,simtemp node or fallback device
+struct simtemp_dev {
+	int id;			//minor and N in /dev/simtempN
+	unsigned int cpu;	//CPU the sampling timer is pinned to
+	
+	//Configuration, the timer reads it with a single RCU dereference
+	struct simtemp_cfg __rcu *cfg;
+	__u32 fifo_size;
+	
+	//Define mutexes
+	struct mutex cfg_lock;	//serializes cfg writers, held while the timer is parked
+	struct mutex ring_lock;
+	struct mutex fifo_size_lock;
+	struct mutex reader_list_lock;
+	
+	//Define spinlock
+	spinlock_t flags_lock;
+	
+	//Dynamically allocated history ring
+	struct hist_ring __rcu *hist;
+	atomic64_t hist_head;	//number of samples ever written
+	atomic64_t hist_reserve;	//end of the batch being written, ahead of hist_head
+	atomic64_t alert_head;	//one past the newest sample with FLAG_THRESHOLD_CROSSED
+	
+	//Open files, walked by the timer under RCU to decide whom to wake
+	struct list_head reader_list;
+	
+	//mmap ring shared with a single userspace consumer
+	struct simtemp_ring_ctrl *ring_ctrl;
+	struct simtemp_sample *ring_data;
+	u32 ring_mask;
+	struct file *ring_owner;	//set under ring_lock, release() clears it and waits a grace period before dropping the lock
+	
+	//Hrtimer variables
+	struct hrtimer timer;
+	
+	//Generation thread of CTX_THREAD, parked with the timer
+	struct task_struct *gen_thread;
+	DECLARE_KFIFO(ticks, struct simtemp_tick, TICK_QUEUE);
+	
+	struct simtemp_sample current_sample;
+	
+	//Replay waveform, swapped under cfg_lock and played by the producer
+	struct wave_table __rcu *wave;
+	u64 wave_gen;		//uploads so far, under cfg_lock
+	u64 wave_seen;		//upload being played, 0 outside MODE_RPL, producer only
+	u32 wave_pos;		//next value to play, producer only
+	
+	//Gaussian draws of the normal and noisy modes, producer only
+	struct gaussian_rng rng;
+	u64 rng_gen;		//seed_gen the state was seeded from
+	bool alert_active;	//alert state with hysteresis, producer only
+	struct simtemp_flags e_flags;
+	struct simtemp_pcpu_stats __percpu *stats;
+	atomic64_t overrun;	//lost samples of every reader, rare enough for a shared counter
+	bool gone;		//removed, open files only wait to be closed
+	
+	//Expiry lateness and callback cost, written by the producer only
+	struct timer_hist lateness;
+	struct timer_hist cost;
+	seqcount_t timer_seq;	//readers retry their copy of both histograms, u64_stats_sync does nothing on 64-bit
+	bool timer_hist_reset;	//requested through debugfs, applied by the timer
+	struct dentry *debugfs_dir;	// /sys/kernel/debug/simtemp/simtempN
+	
+	//Open files and the cdev hold references, the last one frees the instance
+	struct kobject kobj;	// /sys/kernel/simtemp/simtempN
+	struct cdev cdev;
+};
 
-//Hrtimer variables
-static struct hrtimer my_timer;
-static ktime_t kt_period;
+//Per open file state, every reader sees every sample
+struct simtemp_reader {
+	struct simtemp_dev *sdev;
+	struct mutex lock;	//threads sharing this file
+	u64 pos;		//next sample to read
+	u64 overrun;	//samples overwritten before this reader got them
+	u32 format;		//SIMTEMP_FMT_* returned by read()
+	void *batch;	//bounce buffer, filled one chunk at a time in the file format
+	u8 *frame;		//SIMTEMP_FMT_DELTA frame being encoded, allocated with the format
+	struct file *file;
+	
+	//Wakeup coalescing, parameters set through SIMTEMP_IOC_SET_WAKE
+	wait_queue_head_t wq;
+	struct simtemp_wake wake;
+	u64 wake_pos;		//position seen by the timer on its last tick
+	u64 pending_since;	//time the oldest unread sample was queued, timer only
+	u64 woken_pos;		//position at the last wakeup, one edge per position
+	
+	//Aggregation of SIMTEMP_FMT_AGG, the producer folds samples into the open window
+	struct simtemp_window window;
+	struct simtemp_agg agg;	//open window, producer only
+	u64 agg_end_ns;		//end of the open time window, producer only
+	unsigned long agg_reset;	//bit 0 set by SET_FORMAT and SET_WINDOW, tested and cleared by the producer
+	DECLARE_KFIFO(aggs, struct simtemp_agg, AGG_QUEUE);	//closed windows, producer to read()
+	
+	//Alert edges, producer to SIMTEMP_IOC_GET_EVENT
+	DECLARE_KFIFO(events, struct simtemp_event, EVENT_QUEUE);
+	u32 events_lost;	//edges dropped since the last queued one, producer only
+	bool events_new;	//edges queued during this expiry, producer only
+	struct list_head node;
+};
 
 dev_t dev = 0;
 static struct class *dev_class;
-static struct cdev k_cdev;
-struct kobject *kobj_ref;
+struct kobject *kobj_ref; // /sys/kernel/simtemp, parent of every instance
+static DEFINE_IDA(simtemp_ida);
+static struct dentry *debugfs_root; // /sys/kernel/debug/simtemp
 
-static struct simtemp_sample current_sample={.timestamp_ns = 0, .temp_mC = TEMP_MEAN_mC, .flags = 0};
-static struct simtemp_flags e_flags={.counter = 0, .alert = 0, .l_error = E_NO_ERR}; 
+//Instances registered by the module when the DT describes none
+static struct platform_device *fallback_pdevs[SIMTEMP_MAX_DEVICES];
 
 //Prototypes
 static int __init nxp_simtemp_init(void);
@@ -88,8 +301,15 @@ static void __exit nxp_simtemp_exit(void);
 static int nxp_simtemp_open(struct inode *inode,struct file *file);
 static int nxp_simtemp_release(struct inode *inode, struct file *file);
 static ssize_t nxp_simtemp_read(struct file *file, char __user *buf, size_t len, loff_t* off);
-static ssize_t nxp_simtemp_write(struct file *file, const char *buf, size_t len, loff_t* off);
+static ssize_t nxp_simtemp_write(struct file *file, const char __user *buf, size_t len, loff_t* off);
 static unsigned int nxp_simtemp_poll(struct file *file, poll_table *wait);
+static int nxp_simtemp_mmap(struct file *file, struct vm_area_struct *vma);
+static long nxp_simtemp_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+
+//debugfs functions
+static int timer_lateness_show(struct seq_file *m, void *v);
+static int timer_cost_show(struct seq_file *m, void *v);
+static ssize_t timer_hist_reset_write(struct file *file, const char __user *buf, size_t len, loff_t *off);
 
 //sysfs functions
 static ssize_t sampling_us_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
@@ -100,11 +320,42 @@ static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char
 static ssize_t mode_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
 static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
 static ssize_t stats_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t fifo_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t fifo_size_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t tick_us_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t tick_us_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t phase_lock_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t phase_lock_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t context_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t context_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t hysteresis_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t hysteresis_mC_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+static ssize_t seed_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+static ssize_t seed_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
 
 struct kobj_attribute attr_sampling_us = __ATTR(sampling_us, 0660, sampling_us_show,sampling_us_store);
 struct kobj_attribute attr_threshold_mC = __ATTR(threshold_mC, 0660, threshold_mC_show,threshold_mC_store);
 struct kobj_attribute attr_mode= __ATTR(mode, 0660, mode_show,mode_store);
 struct kobj_attribute attr_stats = __ATTR(stats, 0440, stats_show,stats_store);
+struct kobj_attribute attr_fifo_size = __ATTR(fifo_size, 0660, fifo_size_show,fifo_size_store);
+struct kobj_attribute attr_tick_us = __ATTR(tick_us, 0660, tick_us_show,tick_us_store);
+struct kobj_attribute attr_phase_lock = __ATTR(phase_lock, 0660, phase_lock_show,phase_lock_store);
+struct kobj_attribute attr_context = __ATTR(context, 0660, context_show,context_store);
+struct kobj_attribute attr_hysteresis_mC = __ATTR(hysteresis_mC, 0660, hysteresis_mC_show,hysteresis_mC_store);
+struct kobj_attribute attr_seed = __ATTR(seed, 0660, seed_show,seed_store);
+
+//Timer callback
+static enum hrtimer_restart timer_callback(struct hrtimer *timer);
+static enum hrtimer_restart timer_callback_thread(struct hrtimer *timer);
+static int simtemp_gen_thread(void *data);
+
+//History ring functions
+static int hist_resize(struct simtemp_dev *sdev, u32 new_size);
+
+//Wakeup coalescing, shared by the timer and poll()
+static bool reader_due(struct simtemp_reader *reader, u64 pending, u64 now_ns, u64 since_ns, bool alert);
+static bool reader_ready(struct simtemp_reader *reader);
+static ssize_t reader_read_agg(struct file *file, struct simtemp_reader *reader, char __user *buf, size_t len);
 
 // Probe and remove functions
 static int nxp_simtemp_probe(struct platform_device *pdev);
@@ -116,6 +367,12 @@ static struct attribute *sim_temp_attrs[] = {
 	&attr_threshold_mC.attr,
 	&attr_mode.attr,
 	&attr_stats.attr,
+	&attr_fifo_size.attr,
+	&attr_tick_us.attr,
+	&attr_phase_lock.attr,
+	&attr_context.attr,
+	&attr_hysteresis_mC.attr,
+	&attr_seed.attr,
 	NULL,
 };
 
@@ -123,6 +380,33 @@ static struct attribute_group attr_group = {
 	.attrs = sim_temp_attrs,
 };
 
+//Free an instance once the device, its sysfs directory and every open file are gone
+static void simtemp_dev_release(struct kobject *kobj)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	
+	//Probe failed after creating the thread
+	if(sdev->gen_thread)
+	{
+		kthread_stop(sdev->gen_thread);
+	}
+	vfree(sdev->ring_ctrl);
+	vfree(rcu_access_pointer(sdev->hist));
+	kfree(rcu_access_pointer(sdev->cfg));
+	kvfree(rcu_access_pointer(sdev->wave));
+	free_percpu(sdev->stats);
+	if(sdev->id >= 0)
+	{
+		ida_simple_remove(&simtemp_ida, sdev->id);
+	}
+	kfree(sdev);
+}
+
+static struct kobj_type simtemp_ktype = {
+	.release = simtemp_dev_release,
+	.sysfs_ops = &kobj_sysfs_ops,
+};
+
 //File operation structure
 static struct file_operations fops =
 {
@@ -130,10 +414,23 @@ static struct file_operations fops =
 	.read		= nxp_simtemp_read,
 	.write		= nxp_simtemp_write,
 	.poll		= nxp_simtemp_poll,
+	.mmap		= nxp_simtemp_mmap,
+	.unlocked_ioctl	= nxp_simtemp_ioctl,
 	.open		= nxp_simtemp_open,
 	.release	= nxp_simtemp_release,
 };
 
+DEFINE_SHOW_ATTRIBUTE(timer_lateness);
+DEFINE_SHOW_ATTRIBUTE(timer_cost);
+
+static const struct file_operations timer_hist_reset_fops =
+{
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.write		= timer_hist_reset_write,
+	.llseek		= noop_llseek,
+};
+
 static struct of_device_id nxp_simtemp_ids[]= {
 	{
 		.compatible = "nxp,simtemp",
@@ -151,15 +448,14 @@ static struct platform_driver nxp_simtemp_driver = {
 	},
 };
 
-//Function called when loading the driver
-static int nxp_simtemp_probe(struct platform_device *pdev)
+//Read the configuration of a DT node, every property but fifo-size is required
+static int nxp_simtemp_parse_dt(struct simtemp_cfg *cfg, struct device *dev, u32 *fifo_size_dev)
 {
-	struct device *dev = &pdev->dev;
 	struct device_node *np = dev->of_node;
 	
 	int sampling_us_dt, threshold_mC_dt, ret = 0;
-	
-	pr_info("nxp_simtemp: Probe function\n");
+	u32 fifo_size_dt;
+	u64 seed_dt;
 	
 	if(!device_property_present(dev,"sampling-ms"))
 	{
@@ -187,9 +483,9 @@ static int nxp_simtemp_probe(struct platform_device *pdev)
 		return -EINVAL;
 	}
 	
-	sampling_us = sampling_us_dt;
+	cfg->sampling_us = sampling_us_dt;
 	
-	pr_info("nxp_simtemp: from DT sampling_us = %u\n",sampling_us);
+	pr_info("nxp_simtemp: from DT sampling_us = %u\n",cfg->sampling_us);
 	
 	ret = of_property_read_s32(np, "threshold-mC", &threshold_mC_dt);
 	if(ret)
@@ -203,433 +499,2500 @@ static int nxp_simtemp_probe(struct platform_device *pdev)
 		return -EINVAL;
 	}
 	
-	threshold_mC = threshold_mC_dt;
+	cfg->threshold_mC = threshold_mC_dt;
 	
-	pr_info("nxp_simtemp: from DT threshold_mC = %d\n",threshold_mC);
-	
-	return 0;
-}
-
-//Function called on unloading the driver
-
-static int nxp_simtemp_remove(struct platform_device *pdev)
-{
-	pr_info("nxp_simtemp: Remove function\n");
-	return 0;
-}
-
-
-//Function called when we read the sysfs file
-static ssize_t sampling_us_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
-{
-	pr_info("nxp_simtemp: sampling_us - Read\n");
-	return sprintf(buf,"%u\n",READ_ONCE(sampling_us));
-}
-
-static ssize_t sampling_us_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
-{
-	int ret = 0;
-	unsigned long flags;
-	__u32 sampling_us_temp;
+	pr_info("nxp_simtemp: from DT threshold_mC = %d\n",cfg->threshold_mC);
 	
-	pr_info("nxp_simtemp: sampling_us - Write\n");
-	ret = sscanf(buf,"%u",&sampling_us_temp);
-	if(ret)
+	//fifo-size is optional, the module parameter is kept otherwise
+	if(!of_property_read_u32(np, "fifo-size", &fifo_size_dt))
 	{
-		if(sampling_us_temp > TIME_MAX_us || sampling_us_temp < TIME_MIN_us)
+		if(fifo_size_dt > FIFO_SIZE_MAX || fifo_size_dt < FIFO_SIZE_MIN)
 		{
-			spin_lock_irqsave(&flags_lock,flags);
-			e_flags.l_error = E_OR_S_US;
-			spin_unlock_irqrestore(&flags_lock,flags);
+			pr_info("nxp_simtemp: fifo-size from DT out of range\n");
 			return -EINVAL;
 		}
-		mutex_lock(&sampling_us_lock);
-		sampling_us = sampling_us_temp;
-		mutex_unlock(&sampling_us_lock);
-		//Cancel timer
-		hrtimer_cancel(&my_timer);
-		//Update timer
-		kt_period = ktime_set(0,sampling_us*1000);
-		//Restart the timer
-		hrtimer_start(&my_timer,kt_period,HRTIMER_MODE_REL);
-		return count;
+		*fifo_size_dev = roundup_pow_of_two(fifo_size_dt);
+		pr_info("nxp_simtemp: from DT fifo_size = %u\n",*fifo_size_dev);
 	}
-	else
+	
+	//seed is optional, a random one is drawn otherwise
+	if(!of_property_read_u64(np, "seed", &seed_dt))
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_EV_S_US;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		return -EINVAL;
+		cfg->seed = seed_dt;
+		pr_info("nxp_simtemp: from DT seed = %llu\n",cfg->seed);
 	}
+	
+	return 0;
 }
 
-static ssize_t threshold_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+//Set the timer period, below tick_us every expiry generates a batch of samples
+static void simtemp_set_period(struct simtemp_cfg *cfg)
 {
-	pr_info("nxp_simtemp: threshold_mC - Read\n");
-	return sprintf(buf,"%d\n",READ_ONCE(threshold_mC));
+	u32 batch = 1;
+	
+	if(cfg->sampling_us < cfg->tick_us)
+	{
+		batch = min_t(u32, DIV_ROUND_UP(cfg->tick_us, cfg->sampling_us), BATCH_MAX);
+	}
+	cfg->batch = batch;
+	cfg->kt_period = ns_to_ktime((u64)cfg->sampling_us * batch * NSEC_PER_USEC);
 }
 
-static ssize_t threshold_mC_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+//First point after now_ns of the grid of multiples of the period
+static ktime_t simtemp_grid_next(u64 now_ns, ktime_t period)
 {
-	int ret = 0;
-	unsigned long flags;
-	__s32 threshold_mC_temp;
+	u64 period_ns = ktime_to_ns(period);
 	
-	pr_info("nxp_simtemp: threshold_mC - Write\n");
-	ret = sscanf(buf,"%d",&threshold_mC_temp);
+	return ns_to_ktime((div64_u64(now_ns, period_ns) + 1) * period_ns);
+}
+
+//Arm the timer with the published configuration, callers hold cfg_lock
+static void simtemp_timer_arm(struct simtemp_dev *sdev, bool pinned)
+{
+	//Also reached through the IPI of simtemp_timer_start(), whose caller waits for it
+	const struct simtemp_cfg *cfg = rcu_dereference_protected(sdev->cfg, true);
+	//Must match the mode the timer was initialized with
+	enum hrtimer_mode ctx = cfg->context == CTX_SOFTIRQ ? HRTIMER_MODE_SOFT : HRTIMER_MODE_HARD;
 	
-	if(ret)
+	if(cfg->phase_lock)
 	{
-		if(threshold_mC_temp > TEMP_MAX || threshold_mC_temp < TEMP_MIN)
-		{
-			spin_lock_irqsave(&flags_lock,flags);
-			e_flags.l_error = E_OR_TH;
-			spin_unlock_irqrestore(&flags_lock,flags);
-			return -EINVAL;
-		}
-		mutex_lock(&threshold_mC_lock);
-		threshold_mC = threshold_mC_temp;
-		mutex_unlock(&threshold_mC_lock);
-		return count;
+		hrtimer_start(&sdev->timer,simtemp_grid_next(ktime_get_ns(), cfg->kt_period),(pinned ? HRTIMER_MODE_ABS_PINNED : HRTIMER_MODE_ABS) | ctx);
 	}
 	else
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_EV_TH;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		return -EINVAL;
+		hrtimer_start(&sdev->timer,cfg->kt_period,(pinned ? HRTIMER_MODE_REL_PINNED : HRTIMER_MODE_REL) | ctx);
 	}
 }
 
-static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+//Soft or hard expiry is fixed at initialization, the thread context uses a hard one
+static void simtemp_timer_init(struct simtemp_dev *sdev, u8 context)
 {
-	u8 local_mode = READ_ONCE(mode);
-	pr_info("nxp_simtemp: mode - Read\n");
-	if (local_mode == MODE_NRM || local_mode == MODE_NSY || local_mode == MODE_RMP)
-	{
-		return sprintf(buf,"%s\n",modes[local_mode]);
-	}
-	else
-	{
-		return sprintf(buf,"unknown\n");	
-	}
+	hrtimer_init(&sdev->timer,CLOCK_MONOTONIC,context == CTX_SOFTIRQ ? HRTIMER_MODE_REL_SOFT : HRTIMER_MODE_REL_HARD);
+	sdev->timer.function = context == CTX_THREAD ? timer_callback_thread : timer_callback;
 }
 
-static ssize_t mode_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+static void simtemp_timer_start_local(void *data)
 {
-	char tmp_mode;
-	unsigned long flags;
-	
-	pr_info("nxp_simtemp: mode - Write\n");
-	sscanf(buf,"%c",&tmp_mode);
-	
-	switch(tmp_mode)
+	simtemp_timer_arm(data, true);
+}
+
+//Start the sampling timer on the CPU of the instance, so instances spread across CPUs
+static void simtemp_timer_start(struct simtemp_dev *sdev)
+{
+	if(smp_call_function_single(sdev->cpu, simtemp_timer_start_local, sdev, 1))
 	{
-		case '0':
-			mutex_lock(&mode_lock);
-			mode = MODE_NRM;
-			TEMP_STD_mC = 100;
-			mutex_unlock(&mode_lock);
-			pr_info("nxp_simtemp: New mode %d : %s",mode,modes[mode]);
-			break;
-		case '1':
-			mutex_lock(&mode_lock);
-			mode = MODE_NSY;
-			TEMP_STD_mC = 2000;
-			mutex_unlock(&mode_lock);
-			pr_info("nxp_simtemp: New mode %d : %s",mode,modes[mode]);
-			break;
-		case '2':
-			mutex_lock(&mode_lock);
-			mode = MODE_RMP;
-			mutex_unlock(&mode_lock);
-			pr_info("nxp_simtemp: New mode %d : %s",mode,modes[mode]);
-			break;
-		default:
-			pr_info("nxp_simtemp: Invalid mode %d",mode);
-			spin_lock_irqsave(&flags_lock,flags);
-			e_flags.l_error = E_EV_MD;
-			spin_unlock_irqrestore(&flags_lock,flags);
-			return -EINVAL;
+		//The CPU went offline, run on the local one
+		simtemp_timer_arm(sdev, false);
 	}
-	
-	return count;
 }
 
-static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+//Copy of the current configuration, for the slow paths
+static void cfg_get(struct simtemp_dev *sdev, struct simtemp_cfg *cfg)
 {
-	unsigned long flags;
-	int ret = 0;
-	
-	spin_lock_irqsave(&flags_lock,flags);
-	ret = sprintf(buf," Counter:\t%llu\n Alerts:\t%llu\n Last_error:\t%s\n",e_flags.counter,e_flags.alert,sim_errors[e_flags.l_error-10]);
-	spin_unlock_irqrestore(&flags_lock,flags);
-	
-	pr_info("nxp_simtemp: flags - Read\n");
-	
-	return ret; 
+	rcu_read_lock();
+	*cfg = *rcu_dereference(sdev->cfg);
+	rcu_read_unlock();
 }
 
-static ssize_t stats_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+//Start a configuration update, returns a private copy to modify with cfg_lock held, NULL without memory
+static struct simtemp_cfg *cfg_begin(struct simtemp_dev *sdev)
 {
-	pr_info("nxp_simtemp: flags - Write not available\n");
-	return count;
+	struct simtemp_cfg *cfg;
+	
+	mutex_lock(&sdev->cfg_lock);
+	cfg = kmemdup(rcu_dereference_protected(sdev->cfg, lockdep_is_held(&sdev->cfg_lock)), sizeof(*cfg), GFP_KERNEL);
+	if(!cfg)
+	{
+		mutex_unlock(&sdev->cfg_lock);
+	}
+	return cfg;
 }
 
-static int nxp_simtemp_open(struct inode *inode,struct file *file)
+//Stop every producer of samples, returns whether the timer was running. Callers hold cfg_lock
+static int simtemp_park(struct simtemp_dev *sdev)
 {
-	pr_info("nxp_simtemp: Device File Opened \n");
-	return 0;
+	int timer_active = hrtimer_cancel(&sdev->timer);
+	
+	//The thread generates the expiries queued so far before parking
+	kthread_park(sdev->gen_thread);
+	return timer_active;
 }
 
-static int nxp_simtemp_release(struct inode *inode, struct file *file)
+static void simtemp_unpark(struct simtemp_dev *sdev, int timer_active)
 {
-	pr_info("nxp_simtemp: Device File Closed \n");
-	return 0;
+	kthread_unpark(sdev->gen_thread);
+	if(timer_active)
+	{
+		simtemp_timer_start(sdev);
+	}
 }
 
-static ssize_t nxp_simtemp_read(struct file *file, char __user *buf, size_t len, loff_t* off)
+//Publish the copy of cfg_begin() and release cfg_lock
+static int cfg_commit(struct simtemp_dev *sdev, struct simtemp_cfg *cfg)
 {
-	unsigned long flags;
+	struct simtemp_cfg *old_cfg = rcu_dereference_protected(sdev->cfg, lockdep_is_held(&sdev->cfg_lock));
+	int timer_active;
 	
-	spin_lock_irqsave(&fifo_lock,flags);
-	if (kfifo_out(&CBuffer, &current_sample, 1) != 1)
+	//Open files can still get here after remove, nothing must be published anymore
+	if(READ_ONCE(sdev->gone))
 	{
-		pr_warn("nxp_simtemp: Failed to read from FIFO\n");
+		mutex_unlock(&sdev->cfg_lock);
+		kfree(cfg);
+		return -ENODEV;
 	}
-
-	spin_unlock_irqrestore(&fifo_lock,flags);
 	
-	if (copy_to_user((void __user *)buf, &current_sample, sizeof(current_sample)))
+	simtemp_set_period(cfg);
+	if(cfg->context != old_cfg->context)
 	{
-		pr_warn("nxp_simtemp: Failed to copy data to user space\n");
-		return -EFAULT;
+		//The timer is rebuilt for the new context, the only change that restarts it
+		timer_active = simtemp_park(sdev);
+		simtemp_timer_init(sdev, cfg->context);
+		rcu_assign_pointer(sdev->cfg, cfg);
+		simtemp_unpark(sdev, timer_active);
 	}
-	return sizeof(current_sample);
+	else
+	{
+		//The running timer is not touched, its next expiry generates with the new values and re-arms with the new period
+		rcu_assign_pointer(sdev->cfg, cfg);
+	}
+	mutex_unlock(&sdev->cfg_lock);
+	
+	//The timer may still be reading the old copy
+	kfree_rcu(old_cfg, rcu);
+	return 0;
 }
 
-static ssize_t nxp_simtemp_write(struct file *file, const char *buf, size_t len, loff_t* off)
+//Set a mode with its standard deviation, ramp keeps the last one
+static void cfg_set_mode(struct simtemp_cfg *cfg, u8 mode)
 {
-	pr_info("nxp_simtemp: Write function not available\n");
-	return len;
+	cfg->mode = mode;
+	if(mode == MODE_NRM)
+	{
+		cfg->TEMP_STD_mC = 100; // 0.1 °C
+	}
+	else if(mode == MODE_NSY)
+	{
+		cfg->TEMP_STD_mC = 2000; // 2 °C
+	}
 }
 
-static unsigned int nxp_simtemp_poll(struct file *file, poll_table *wait)
+//SCHED_FIFO at half the RT range, sched_set_fifo() only exists from 5.9 and replaced the exported setscheduler calls
+static void simtemp_thread_set_fifo(struct task_struct *task)
 {
-	unsigned int mask = 0;
-	unsigned long flags;
-	
-	poll_wait(file,&wq,wait);
-	//pr_info("nxp_simtemp: Set POLLIN | POLLRDNORM flags\n");
-	
-	spin_lock_irqsave(&fifo_lock,flags);
-	if(!kfifo_is_empty(&CBuffer))
-	{
-		mask |= POLLIN | POLLRDNORM;
-	}
-	spin_unlock_irqrestore(&fifo_lock,flags);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+	sched_set_fifo(task);
+#else
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
 	
-	return mask;
+	sched_setscheduler_nocheck(task, SCHED_FIFO, &param);
+#endif
 }
 
-static enum hrtimer_restart timer_callback(struct hrtimer *timer)
+//Function called for every nxp,simtemp node and fallback device
+static int nxp_simtemp_probe(struct platform_device *pdev)
 {
-	struct simtemp_sample old_value;
-	unsigned long flags;
-	u8 local_mode = READ_ONCE(mode);
-	s32 threshold_mC_local = READ_ONCE(threshold_mC);
+	struct simtemp_dev *sdev;
+	struct simtemp_cfg *cfg;
+	struct device *class_dev;
+	u32 fifo_size_dev = fifo_size;
+	int cpu, ret = 0;
 	
+	pr_info("nxp_simtemp: Probe function\n");
 	
-	if(local_mode == MODE_NRM || local_mode == MODE_NSY)
-	{
-		current_sample.temp_mC = gaussian_s32_clt(TEMP_MEAN_mC, READ_ONCE(TEMP_STD_mC));
-	}
-	else
+	sdev = kzalloc(sizeof(*sdev), GFP_KERNEL);
+	if(!sdev)
 	{
-		current_sample.temp_mC = ((current_sample.temp_mC + 1000 - TEMP_MIN) % (TEMP_MAX - TEMP_MIN + 1)) + TEMP_MIN;
+		return -ENOMEM;
 	}
-	current_sample.timestamp_ns = ktime_get_real_ns();
-	current_sample.flags = FLAG_NEW_SAMPLE;
-	
-	spin_lock_irqsave(&flags_lock,flags);
-	e_flags.counter += 1;
-	spin_unlock_irqrestore(&flags_lock,flags);
+	//From here on kobject_put() frees the instance and whatever it holds
+	kobject_init(&sdev->kobj, &simtemp_ktype);
+	sdev->id = -1;
 	
-	if (current_sample.temp_mC > threshold_mC_local)
+	//Nobody reads the configuration before the timer starts, it is filled in place
+	cfg = kzalloc(sizeof(*cfg), GFP_KERNEL);
+	if(!cfg)
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.alert += 1;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		current_sample.flags |= FLAG_THRESHOLD_CROSSED; 
+		ret = -ENOMEM;
+		goto r_put;
 	}
+	RCU_INIT_POINTER(sdev->cfg, cfg);
+	cfg->sampling_us = SAMPLING_us_DEFAULT;
+	cfg->threshold_mC = THRESHOLD_mC_DEFAULT;
+	cfg->mode = MODE_RMP;
+	cfg->TEMP_STD_mC = 100; // 0.1 °C
+	cfg->tick_us = TICK_us_DEFAULT;
+	cfg->context = CTX_HARDIRQ;
+	//Runs differ unless a seed is given, the one drawn is shown in sysfs to repeat a run
+	cfg->seed = get_random_u64();
+	cfg->seed_gen = 1;
+	sdev->current_sample.temp_mC = TEMP_MEAN_mC;
+	sdev->e_flags.l_error = E_NO_ERR;
 	
-	spin_lock_irqsave(&fifo_lock,flags);
+	mutex_init(&sdev->cfg_lock);
+	mutex_init(&sdev->ring_lock);
+	mutex_init(&sdev->fifo_size_lock);
+	mutex_init(&sdev->reader_list_lock);
+	spin_lock_init(&sdev->flags_lock);
+	atomic64_set(&sdev->hist_head, 0);
+	atomic64_set(&sdev->hist_reserve, 0);
+	atomic64_set(&sdev->alert_head, 0);
+	atomic64_set(&sdev->overrun, 0);
+	INIT_LIST_HEAD(&sdev->reader_list);
+	INIT_KFIFO(sdev->ticks);
 	
-	if(kfifo_is_full(&CBuffer))
+	//DT nodes carry their configuration, fallback devices keep the defaults
+	if(pdev->dev.of_node)
 	{
-		if (kfifo_out(&CBuffer, &old_value, 1) != 1) 
+		ret = nxp_simtemp_parse_dt(cfg, &pdev->dev, &fifo_size_dev);
+		if(ret)
 		{
-			pr_warn("nxp_simtemp: Failed to remove old value from FIFO\n");
+			goto r_put;
 		}
-
-		//pr_info("nxp_simtemp: CBuffer full, oldest value %d dropped\n", old_value);
 	}
-	kfifo_in(&CBuffer,&current_sample,1);
-	//pr_info("nxp_simtemp: %llu | Inserted %d into CBuffer\n",current_sample.timestamp_ns,current_sample.temp_mC);
-	spin_unlock_irqrestore(&fifo_lock,flags);
 	
-	wake_up_interruptible(&wq);
+	ret = ida_simple_get(&simtemp_ida, 0, SIMTEMP_MAX_DEVICES, GFP_KERNEL);
+	if(ret < 0)
+	{
+		pr_info("nxp_simtemp: No minor left for a new instance\n");
+		goto r_put;
+	}
+	sdev->id = ret;
+	sdev->cpu = cpumask_local_spread(sdev->id, NUMA_NO_NODE);
 	
-	//Re-arm the timer
-	hrtimer_forward_now(timer,kt_period);
-	return HRTIMER_RESTART;
-}
-
-static int __init nxp_simtemp_init(void)
-{
-	unsigned long flags;
+	// Init per CPU counters
+	sdev->stats = alloc_percpu(struct simtemp_pcpu_stats);
+	if(!sdev->stats)
+	{
+		ret = -ENOMEM;
+		goto r_put;
+	}
+	for_each_possible_cpu(cpu)
+	{
+		u64_stats_init(&per_cpu_ptr(sdev->stats, cpu)->syncp);
+	}
+	seqcount_init(&sdev->timer_seq);
+	sdev->lateness.min_ns = U64_MAX;
+	sdev->cost.min_ns = U64_MAX;
 	
-	// Load the driver
-	if(platform_driver_register(&nxp_simtemp_driver))
+	//Allocate the mmap ring, zeroed and suitable for remap_vmalloc_range()
+	sdev->ring_ctrl = vmalloc_user(RING_BYTES);
+	if(!sdev->ring_ctrl)
 	{
-		pr_info("nxp_simtemp: Error.Could not load the driver\n");
-		return -1;
+		pr_err("nxp_simtemp: Cannot allocate mmap ring\n");
+		ret = -ENOMEM;
+		goto r_put;
 	}
+	sdev->ring_data = (struct simtemp_sample *)((u8 *)sdev->ring_ctrl + PAGE_SIZE);
+	sdev->ring_mask = (SIMTEMP_RING_PAGES * PAGE_SIZE) / sizeof(struct simtemp_sample) - 1;
+	sdev->ring_ctrl->data_offset = PAGE_SIZE;
+	sdev->ring_ctrl->data_size = sdev->ring_mask + 1;
 	
-	// Init spinlocks
-	spin_lock_init(&fifo_lock);
-	spin_lock_init(&flags_lock);
+	//Allocate the history ring with the depth given as module parameter or in DT
+	ret = hist_resize(sdev, fifo_size_dev);
+	if(ret)
+	{
+		goto r_put;
+	}
 	
 	// Set the timer interval
-	kt_period = ktime_set(0,sampling_us*1000); // seconds, nanoseconds
+	simtemp_set_period(cfg);
 	
 	// Initialize the hrtimer
-	hrtimer_init(&my_timer,CLOCK_MONOTONIC,HRTIMER_MODE_REL);
-	my_timer.function = timer_callback;
+	simtemp_timer_init(sdev, cfg->context);
 	
-	//Allocate Major Number
-	if((alloc_chrdev_region(&dev, 0, 1,"simtemp"))<0)
+	//Real-time priority like a threaded interrupt, on the CPU of the timer
+	sdev->gen_thread = kthread_create(simtemp_gen_thread, sdev, "simtemp%d", sdev->id);
+	if(IS_ERR(sdev->gen_thread))
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_MN_ALLOC;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_info("nxp_simtemp: Cannot allocate major number\n");
-		return -1;
+		pr_err("nxp_simtemp: Cannot create the generation thread\n");
+		ret = PTR_ERR(sdev->gen_thread);
+		sdev->gen_thread = NULL;
+		goto r_put;
 	}
-	pr_info("nxp_simtemp: Major = %d Minor = %d \n", MAJOR(dev),MINOR(dev));
+	set_cpus_allowed_ptr(sdev->gen_thread, cpumask_of(sdev->cpu));
+	simtemp_thread_set_fifo(sdev->gen_thread);
+	wake_up_process(sdev->gen_thread);
 	
-	//Create cdev structure
-	cdev_init(&k_cdev,&fops);
-	
-	//Adding character device to the system
-	if((cdev_add(&k_cdev,dev,1)) < 0)
+	//Create a directory in /sys/kernel/simtemp/
+	ret = kobject_add(&sdev->kobj, kobj_ref, "simtemp%d", sdev->id);
+	if(ret)
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_DV_ADD;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_info("nxp_simtemp: Cannot add the device to the system\n");
-		goto r_class;
+		pr_err("nxp_simtemp: Cannot create kobject\n");
+		goto r_put;
 	}
 	
-	//Create struct class
-	if(IS_ERR(dev_class = class_create(THIS_MODULE,"simtemp")))
+	//Create sysfs files of the instance
+	ret = sysfs_create_group(&sdev->kobj,&attr_group);
+	if(ret)
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_CL_CREATE;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_info("nxp_simtemp: Cannot create the struct class\n");
-		goto r_class;
+		pr_err("nxp_simtemp: Cannot create sysfs group\n");
+		goto r_put;
 	}
 	
-	//Create device
-	if(IS_ERR(device_create(dev_class,NULL,dev,NULL,"simtemp")))
+	//Adding character device to the system, open files pin the instance through its parent
+	cdev_init(&sdev->cdev,&fops);
+	sdev->cdev.owner = THIS_MODULE;
+	cdev_set_parent(&sdev->cdev, &sdev->kobj);
+	ret = cdev_add(&sdev->cdev,MKDEV(MAJOR(dev), sdev->id),1);
+	if(ret < 0)
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_DV_CREATE;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_info("nxp_simtemp: Cannot create the Device 1\n");
-		goto r_device;
-		
+		pr_info("nxp_simtemp: Cannot add the device to the system\n");
+		goto r_put;
 	}
 	
-	//Create a directory in /sys/kernel/
-	kobj_ref = kobject_create_and_add("simtemp",kernel_kobj);
-	if(!kobj_ref)
+	//Create device
+	class_dev = device_create(dev_class,&pdev->dev,sdev->cdev.dev,sdev,"simtemp%d",sdev->id);
+	if(IS_ERR(class_dev))
 	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_KO_CREATE;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_err("Cannot create kobject\n");
-		return -ENOMEM;
+		pr_info("nxp_simtemp: Cannot create the Device simtemp%d\n",sdev->id);
+		ret = PTR_ERR(class_dev);
+		goto r_cdev;
 	}
 	
-	//Create sysfs file for k_value
-	if(sysfs_create_group(kobj_ref,&attr_group))
-	{
-		spin_lock_irqsave(&flags_lock,flags);
-		e_flags.l_error = E_SYS_CREATE;
-		spin_unlock_irqrestore(&flags_lock,flags);
-		
-		pr_err("Cannot create sysfs group\n");
-		goto r_sysfs;			
-	}
+	platform_set_drvdata(pdev, sdev);
+	
+	//Timer histograms, debugfs errors are not fatal
+	sdev->debugfs_dir = debugfs_create_dir(dev_name(class_dev), debugfs_root);
+	debugfs_create_file("timer_lateness", 0444, sdev->debugfs_dir, sdev, &timer_lateness_fops);
+	debugfs_create_file("timer_cost", 0444, sdev->debugfs_dir, sdev, &timer_cost_fops);
+	debugfs_create_file("timer_reset", 0200, sdev->debugfs_dir, sdev, &timer_hist_reset_fops);
 	
 	//Start the timer
-	hrtimer_start(&my_timer,kt_period,HRTIMER_MODE_REL);
+	mutex_lock(&sdev->cfg_lock);
+	simtemp_timer_start(sdev);
+	mutex_unlock(&sdev->cfg_lock);
 	
-	pr_info("nxp_simtemp: Device Driver Insert Done\n");
+	pr_info("nxp_simtemp: simtemp%d sampling on CPU %u\n",sdev->id,sdev->cpu);
 	return 0;
+	
+r_cdev:
+	cdev_del(&sdev->cdev);
+r_put:
+	kobject_put(&sdev->kobj);
+	return ret;
+}
 
-r_sysfs:
-	sysfs_remove_group(kobj_ref,&attr_group);
+//Function called on unloading the driver
+
+static int nxp_simtemp_remove(struct platform_device *pdev)
+{
+	struct simtemp_dev *sdev = platform_get_drvdata(pdev);
+	struct simtemp_reader *reader;
+	
+	pr_info("nxp_simtemp: Remove function\n");
+	
+	//No new opens nor sysfs writes
+	debugfs_remove_recursive(sdev->debugfs_dir);
+	device_destroy(dev_class,sdev->cdev.dev);
+	cdev_del(&sdev->cdev);
+	sysfs_remove_group(&sdev->kobj,&attr_group);
+	kobject_del(&sdev->kobj);
+	
+	//Open files can still reach SIMTEMP_IOC_SET_CONFIG, cfg_commit() checks gone before publishing
+	mutex_lock(&sdev->cfg_lock);
+	WRITE_ONCE(sdev->gone, true);
+	mutex_unlock(&sdev->cfg_lock);
+	
+	//Cancel the timer if it's active
+	if(hrtimer_cancel(&sdev->timer))
+		pr_info("nxp_simtemp: Timer was still active and canceled\n");
+	kthread_stop(sdev->gen_thread);
+	sdev->gen_thread = NULL;
+	
+	//No sample will come anymore, release blocked readers
+	rcu_read_lock();
+	list_for_each_entry_rcu(reader, &sdev->reader_list, node)
+	{
+		wake_up_interruptible(&reader->wq);
+	}
+	rcu_read_unlock();
+	
+	//Files still open keep the instance until they are closed
+	kobject_put(&sdev->kobj);
+	return 0;
+}
+
+
+//Function called when we read the sysfs file
+static ssize_t sampling_us_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: sampling_us - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%u\n",cfg.sampling_us);
+}
+
+static ssize_t sampling_us_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	__u32 sampling_us_temp;
+	
+	pr_info("nxp_simtemp: sampling_us - Write\n");
+	ret = sscanf(buf,"%u",&sampling_us_temp);
+	if(ret)
+	{
+		if(sampling_us_temp > TIME_MAX_us || sampling_us_temp < TIME_MIN_us)
+		{
+			spin_lock_irqsave(&sdev->flags_lock,flags);
+			sdev->e_flags.l_error = E_OR_S_US;
+			spin_unlock_irqrestore(&sdev->flags_lock,flags);
+			return -EINVAL;
+		}
+		cfg = cfg_begin(sdev);
+		if(!cfg)
+		{
+			return -ENOMEM;
+		}
+		cfg->sampling_us = sampling_us_temp;
+		//The new period starts at the next expiry
+		ret = cfg_commit(sdev, cfg);
+		return ret ? ret : count;
+	}
+	else
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_S_US;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+}
+
+static ssize_t threshold_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: threshold_mC - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%d\n",cfg.threshold_mC);
+}
+
+static ssize_t threshold_mC_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	__s32 threshold_mC_temp;
+	
+	pr_info("nxp_simtemp: threshold_mC - Write\n");
+	ret = sscanf(buf,"%d",&threshold_mC_temp);
+	
+	if(ret)
+	{
+		if(threshold_mC_temp > TEMP_MAX || threshold_mC_temp < TEMP_MIN)
+		{
+			spin_lock_irqsave(&sdev->flags_lock,flags);
+			sdev->e_flags.l_error = E_OR_TH;
+			spin_unlock_irqrestore(&sdev->flags_lock,flags);
+			return -EINVAL;
+		}
+		cfg = cfg_begin(sdev);
+		if(!cfg)
+		{
+			return -ENOMEM;
+		}
+		cfg->threshold_mC = threshold_mC_temp;
+		ret = cfg_commit(sdev, cfg);
+		return ret ? ret : count;
+	}
+	else
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_TH;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+}
+
+static ssize_t hysteresis_mC_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: hysteresis_mC - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%u\n",cfg.hysteresis_mC);
+}
+
+static ssize_t hysteresis_mC_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	__u32 hysteresis_mC_temp;
+	
+	pr_info("nxp_simtemp: hysteresis_mC - Write\n");
+	ret = sscanf(buf,"%u",&hysteresis_mC_temp);
+	
+	if(ret == 1)
+	{
+		if(hysteresis_mC_temp > HYSTERESIS_MAX_mC)
+		{
+			spin_lock_irqsave(&sdev->flags_lock,flags);
+			sdev->e_flags.l_error = E_OR_HY;
+			spin_unlock_irqrestore(&sdev->flags_lock,flags);
+			return -EINVAL;
+		}
+		cfg = cfg_begin(sdev);
+		if(!cfg)
+		{
+			return -ENOMEM;
+		}
+		cfg->hysteresis_mC = hysteresis_mC_temp;
+		ret = cfg_commit(sdev, cfg);
+		return ret ? ret : count;
+	}
+	else
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_HY;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+}
+
+static ssize_t seed_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: seed - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%llu\n",cfg.seed);
+}
+
+static ssize_t seed_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	u64 seed_temp;
+	
+	pr_info("nxp_simtemp: seed - Write\n");
+	ret = kstrtou64(buf, 0, &seed_temp);
+	if(ret)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_SD;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	
+	//Writing the same seed again restarts its sequence too
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg->seed = seed_temp;
+	cfg->seed_gen++;
+	ret = cfg_commit(sdev, cfg);
+	return ret ? ret : count;
+}
+
+static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	u8 local_mode;
+	
+	cfg_get(sdev, &cfg);
+	local_mode = cfg.mode;
+	pr_info("nxp_simtemp: mode - Read\n");
+	if (local_mode == MODE_NRM || local_mode == MODE_NSY || local_mode == MODE_RMP || local_mode == MODE_RPL)
+	{
+		return sprintf(buf,"%s\n",modes[local_mode]);
+	}
+	else
+	{
+		return sprintf(buf,"unknown\n");	
+	}
+}
+
+static ssize_t mode_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	char tmp_mode;
+	unsigned long flags;
+	u8 new_mode;
+	int ret = 0;
+	
+	pr_info("nxp_simtemp: mode - Write\n");
+	sscanf(buf,"%c",&tmp_mode);
+	
+	switch(tmp_mode)
+	{
+		case '0':
+			new_mode = MODE_NRM;
+			break;
+		case '1':
+			new_mode = MODE_NSY;
+			break;
+		case '2':
+			new_mode = MODE_RMP;
+			break;
+		case '3':
+			new_mode = MODE_RPL;
+			break;
+		default:
+			pr_info("nxp_simtemp: Invalid mode %c",tmp_mode);
+			spin_lock_irqsave(&sdev->flags_lock,flags);
+			sdev->e_flags.l_error = E_EV_MD;
+			spin_unlock_irqrestore(&sdev->flags_lock,flags);
+			return -EINVAL;
+	}
+	
+	//Mode and standard deviation are published together
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg_set_mode(cfg, new_mode);
+	ret = cfg_commit(sdev, cfg);
+	if(ret)
+	{
+		return ret;
+	}
+	pr_info("nxp_simtemp: New mode %d : %s",new_mode,modes[new_mode]);
+	
+	return count;
+}
+
+//Sum the per CPU counters and take the last error
+static void stats_snapshot(struct simtemp_dev *sdev, struct simtemp_flags *snap)
+{
+	struct simtemp_pcpu_stats *stats;
+	unsigned int start;
+	unsigned long flags;
+	u64 counter, alert;
+	int cpu;
+	
+	snap->counter = 0;
+	snap->alert = 0;
+	for_each_possible_cpu(cpu)
+	{
+		stats = per_cpu_ptr(sdev->stats, cpu);
+		do
+		{
+			start = u64_stats_fetch_begin(&stats->syncp);
+			counter = stats->counter;
+			alert = stats->alert;
+		} while(u64_stats_fetch_retry(&stats->syncp, start));
+		snap->counter += counter;
+		snap->alert += alert;
+	}
+	
+	spin_lock_irqsave(&sdev->flags_lock,flags);
+	snap->l_error = sdev->e_flags.l_error;
+	spin_unlock_irqrestore(&sdev->flags_lock,flags);
+	
+	snap->overrun = atomic64_read(&sdev->overrun);
+}
+
+//Configuration and stats as returned by SIMTEMP_IOC_GET_CONFIG
+static void simtemp_get_status(struct simtemp_dev *sdev, struct simtemp_status *status)
+{
+	struct simtemp_cfg cfg;
+	
+	memset(status, 0, sizeof(*status));
+	cfg_get(sdev, &cfg);
+	status->config.sampling_us = cfg.sampling_us;
+	status->config.threshold_mC = cfg.threshold_mC;
+	status->config.mode = cfg.mode;
+	status->config.tick_us = cfg.tick_us;
+	status->config.phase_lock = cfg.phase_lock;
+	status->config.context = cfg.context;
+	status->config.hysteresis_mC = cfg.hysteresis_mC;
+	status->config.fifo_size = READ_ONCE(sdev->fifo_size);
+	stats_snapshot(sdev, &status->stats);
+}
+
+//Apply a whole configuration, published at once so no expiry sees part of it
+static int simtemp_set_config(struct simtemp_dev *sdev, const struct simtemp_config *config)
+{
+	struct simtemp_cfg *cfg;
+	unsigned long flags;
+	__u8 error = E_NO_ERR;
+	int ret = 0;
+	
+	if(config->sampling_us > TIME_MAX_us || config->sampling_us < TIME_MIN_us)
+	{
+		error = E_OR_S_US;
+	}
+	else if(config->threshold_mC > TEMP_MAX || config->threshold_mC < TEMP_MIN)
+	{
+		error = E_OR_TH;
+	}
+	else if(config->mode != MODE_NRM && config->mode != MODE_NSY && config->mode != MODE_RMP && config->mode != MODE_RPL)
+	{
+		error = E_EV_MD;
+	}
+	else if(config->tick_us > TICK_MAX_us || config->tick_us < TICK_MIN_us)
+	{
+		error = E_OR_TK;
+	}
+	else if(config->phase_lock > 1)
+	{
+		error = E_EV_PL;
+	}
+	else if(config->context > CTX_THREAD)
+	{
+		error = E_EV_CX;
+	}
+	else if(config->hysteresis_mC > HYSTERESIS_MAX_mC)
+	{
+		error = E_OR_HY;
+	}
+	if(error != E_NO_ERR)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = error;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg->sampling_us = config->sampling_us;
+	cfg->tick_us = config->tick_us;
+	cfg->phase_lock = config->phase_lock;
+	cfg->context = config->context;
+	cfg->threshold_mC = config->threshold_mC;
+	cfg->hysteresis_mC = config->hysteresis_mC;
+	cfg_set_mode(cfg, config->mode);
+	ret = cfg_commit(sdev, cfg);
+	if(ret)
+	{
+		return ret;
+	}
+	pr_info("nxp_simtemp: simtemp%d config sampling_us = %u threshold_mC = %d mode = %s\n",sdev->id,config->sampling_us,config->threshold_mC,modes[config->mode]);
+	return 0;
+}
+
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_flags snap;
+	int ret = 0;
+	
+	stats_snapshot(sdev, &snap);
+	ret = sprintf(buf," Counter:\t%llu\n Alerts:\t%llu\n Overrun:\t%llu\n Last_error:\t%s\n",snap.counter,snap.alert,snap.overrun,sim_errors[snap.l_error-10]);
+	
+	pr_info("nxp_simtemp: flags - Read\n");
+	
+	return ret; 
+}
+
+static ssize_t stats_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	pr_info("nxp_simtemp: flags - Write not available\n");
+	return count;
+}
+
+//Largest value counted in a bucket
+static u64 timer_hist_bound(unsigned int b)
+{
+	return b == 0 ? 0 : (b == 64 ? U64_MAX : (1ULL << b) - 1);
+}
+
+//Upper bound of the bucket holding the given percentile, exact to a power of two
+static u64 timer_hist_percentile(const struct timer_hist *h, unsigned int percent)
+{
+	u64 cum = 0;
+	unsigned int b;
+	
+	for(b = 0; b < TIMER_HIST_BUCKETS; b++)
+	{
+		cum += h->bucket[b];
+		if(cum * 100 >= h->count * percent)
+		{
+			return min(timer_hist_bound(b), h->max_ns);
+		}
+	}
+	return h->max_ns;
+}
+
+static void timer_hist_print(struct seq_file *m, struct simtemp_dev *sdev, bool cost)
+{
+	struct timer_hist *h;
+	unsigned int start, b;
+	
+	h = kmalloc(sizeof(*h), GFP_KERNEL);
+	if(!h)
+	{
+		return;
+	}
+	do
+	{
+		start = read_seqcount_begin(&sdev->timer_seq);
+		*h = cost ? sdev->cost : sdev->lateness;
+	} while(read_seqcount_retry(&sdev->timer_seq, start));
+	
+	seq_printf(m, "count:\t%llu\n", h->count);
+	if(h->count)
+	{
+		seq_printf(m, "min_ns:\t%llu\nmax_ns:\t%llu\n", h->min_ns, h->max_ns);
+		seq_printf(m, "p50_ns:\t<= %llu\np99_ns:\t<= %llu\n", timer_hist_percentile(h, 50), timer_hist_percentile(h, 99));
+		for(b = 0; b < TIMER_HIST_BUCKETS; b++)
+		{
+			if(h->bucket[b])
+			{
+				seq_printf(m, "[%llu, %llu]\t%llu\n", b ? timer_hist_bound(b - 1) + 1 : 0, timer_hist_bound(b), h->bucket[b]);
+			}
+		}
+	}
+	kfree(h);
+}
+
+//How late the timer expired compared to its programmed expiry
+static int timer_lateness_show(struct seq_file *m, void *v)
+{
+	timer_hist_print(m, m->private, false);
+	return 0;
+}
+
+//Time spent in timer_callback()
+static int timer_cost_show(struct seq_file *m, void *v)
+{
+	timer_hist_print(m, m->private, true);
+	return 0;
+}
+
+static ssize_t timer_hist_reset_write(struct file *file, const char __user *buf, size_t len, loff_t *off)
+{
+	struct simtemp_dev *sdev = file->private_data;
+	
+	//The timer is the only writer of the histograms, it clears them on its next expiry
+	WRITE_ONCE(sdev->timer_hist_reset, true);
+	return len;
+}
+
+static ssize_t fifo_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	pr_info("nxp_simtemp: fifo_size - Read\n");
+	return sprintf(buf,"%u\n",READ_ONCE(sdev->fifo_size));
+}
+
+static ssize_t fifo_size_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	int ret = 0;
+	unsigned long flags;
+	__u32 fifo_size_temp;
+	
+	pr_info("nxp_simtemp: fifo_size - Write\n");
+	ret = sscanf(buf,"%u",&fifo_size_temp);
+	if(ret != 1)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_FS;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	if(fifo_size_temp > FIFO_SIZE_MAX || fifo_size_temp < FIFO_SIZE_MIN)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_OR_FS;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	
+	ret = hist_resize(sdev, roundup_pow_of_two(fifo_size_temp));
+	if(ret)
+	{
+		return ret;
+	}
+	return count;
+}
+
+static ssize_t tick_us_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: tick_us - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%u\n",cfg.tick_us);
+}
+
+static ssize_t tick_us_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	__u32 tick_us_temp;
+	
+	pr_info("nxp_simtemp: tick_us - Write\n");
+	ret = sscanf(buf,"%u",&tick_us_temp);
+	if(ret != 1)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_TK;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	if(tick_us_temp > TICK_MAX_us || tick_us_temp < TICK_MIN_us)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_OR_TK;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	
+	//The batch size and the period follow, like for sampling_us
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg->tick_us = tick_us_temp;
+	ret = cfg_commit(sdev, cfg);
+	return ret ? ret : count;
+}
+
+static ssize_t phase_lock_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: phase_lock - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%d\n",cfg.phase_lock);
+}
+
+static ssize_t phase_lock_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	int ret = 0;
+	unsigned long flags;
+	__u32 phase_lock_temp;
+	
+	pr_info("nxp_simtemp: phase_lock - Write\n");
+	ret = sscanf(buf,"%u",&phase_lock_temp);
+	if(ret != 1 || phase_lock_temp > 1)
+	{
+		spin_lock_irqsave(&sdev->flags_lock,flags);
+		sdev->e_flags.l_error = E_EV_PL;
+		spin_unlock_irqrestore(&sdev->flags_lock,flags);
+		return -EINVAL;
+	}
+	
+	//Takes effect when the timer re-arms after its next expiry
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg->phase_lock = phase_lock_temp;
+	ret = cfg_commit(sdev, cfg);
+	return ret ? ret : count;
+}
+
+static ssize_t context_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg cfg;
+	
+	pr_info("nxp_simtemp: context - Read\n");
+	cfg_get(sdev, &cfg);
+	return sprintf(buf,"%s\n",contexts[cfg.context]);
+}
+
+static ssize_t context_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct simtemp_dev *sdev = container_of(kobj, struct simtemp_dev, kobj);
+	struct simtemp_cfg *cfg;
+	char tmp_context;
+	unsigned long flags;
+	u8 new_context;
+	int ret = 0;
+	
+	pr_info("nxp_simtemp: context - Write\n");
+	sscanf(buf,"%c",&tmp_context);
+	
+	switch(tmp_context)
+	{
+		case '0':
+			new_context = CTX_HARDIRQ;
+			break;
+		case '1':
+			new_context = CTX_SOFTIRQ;
+			break;
+		case '2':
+			new_context = CTX_THREAD;
+			break;
+		default:
+			pr_info("nxp_simtemp: Invalid context %c",tmp_context);
+			spin_lock_irqsave(&sdev->flags_lock,flags);
+			sdev->e_flags.l_error = E_EV_CX;
+			spin_unlock_irqrestore(&sdev->flags_lock,flags);
+			return -EINVAL;
+	}
+	
+	//Restarts the timer in the new context
+	cfg = cfg_begin(sdev);
+	if(!cfg)
+	{
+		return -ENOMEM;
+	}
+	cfg->context = new_context;
+	ret = cfg_commit(sdev, cfg);
+	if(ret)
+	{
+		return ret;
+	}
+	pr_info("nxp_simtemp: New context %d : %s",new_context,contexts[new_context]);
+	
+	return count;
+}
+
+//Swap in a new history ring, keeping the newest samples at their positions
+static int hist_resize(struct simtemp_dev *sdev, u32 new_size)
+{
+	struct hist_ring *new_ring, *old_ring;
+	u64 head, pos;
+	u32 n_keep = 0;
+	int timer_active = 0;
+	
+	//Large rings do not fit in kmalloc, use vmalloc
+	new_ring = vzalloc(struct_size(new_ring, buf, new_size));
+	if(!new_ring)
+	{
+		pr_err("nxp_simtemp: Cannot allocate history ring of %u samples\n",new_size);
+		return -ENOMEM;
+	}
+	new_ring->size = new_size;
+	
+	mutex_lock(&sdev->fifo_size_lock);
+	old_ring = rcu_dereference_protected(sdev->hist, lockdep_is_held(&sdev->fifo_size_lock));
+	
+	//The producer is the only lockless writer, park it while copying
+	mutex_lock(&sdev->cfg_lock);
+	if(old_ring)
+	{
+		timer_active = simtemp_park(sdev);
+		
+		//Reader positions are absolute, so queued samples keep their index
+		head = atomic64_read(&sdev->hist_head);
+		n_keep = min_t(u64, min(old_ring->size, new_size), head);
+		for(pos = head - n_keep; pos < head; pos++)
+		{
+			new_ring->buf[pos & (new_size - 1)] = old_ring->buf[pos & (old_ring->size - 1)];
+		}
+	}
+	rcu_assign_pointer(sdev->hist, new_ring);
+	if(old_ring)
+	{
+		simtemp_unpark(sdev, timer_active);
+	}
+	mutex_unlock(&sdev->cfg_lock);
+	
+	WRITE_ONCE(sdev->fifo_size, new_size);
+	mutex_unlock(&sdev->fifo_size_lock);
+	
+	//Readers may still be copying from the old ring
+	synchronize_rcu();
+	vfree(old_ring);
+	pr_info("nxp_simtemp: History ring resized to %u samples\n",new_size);
+	
+	return 0;
+}
+
+static int nxp_simtemp_open(struct inode *inode,struct file *file)
+{
+	struct simtemp_dev *sdev = container_of(inode->i_cdev, struct simtemp_dev, cdev);
+	struct simtemp_reader *reader;
+	
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if(!reader)
+	{
+		return -ENOMEM;
+	}
+	//Sized for the largest record format
+	reader->batch = kmalloc_array(READ_CHUNK, sizeof(struct simtemp_sample_v2), GFP_KERNEL);
+	if(!reader->batch)
+	{
+		kfree(reader);
+		return -ENOMEM;
+	}
+	mutex_init(&reader->lock);
+	init_waitqueue_head(&reader->wq);
+	reader->file = file;
+	reader->sdev = sdev;
+	
+	//Wake on every sample until told otherwise
+	reader->wake.samples = 1;
+	reader->format = SIMTEMP_FMT_V1;
+	
+	//A new reader starts with the next generated sample
+	reader->pos = atomic64_read(&sdev->hist_head);
+	reader->wake_pos = reader->pos;
+	reader->woken_pos = U64_MAX;
+	reader->window.samples = WINDOW_SAMPLES_DEFAULT;
+	INIT_KFIFO(reader->aggs);
+	INIT_KFIFO(reader->events);
+	
+	file->private_data = reader;
+	
+	//The instance outlives its removal while files are open
+	kobject_get(&sdev->kobj);
+	
+	mutex_lock(&sdev->reader_list_lock);
+	list_add_tail_rcu(&reader->node, &sdev->reader_list);
+	mutex_unlock(&sdev->reader_list_lock);
+	
+	pr_info("nxp_simtemp: Device File Opened \n");
+	return 0;
+}
+
+static int nxp_simtemp_release(struct inode *inode, struct file *file)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	
+	//Stop feeding the mmap ring once its consumer goes away, a new owner may only reset it once no callback still pushes with the old head
+	mutex_lock(&sdev->ring_lock);
+	if(sdev->ring_owner == file)
+	{
+		WRITE_ONCE(sdev->ring_owner, NULL);
+		synchronize_rcu();
+	}
+	mutex_unlock(&sdev->ring_lock);
+	
+	mutex_lock(&sdev->reader_list_lock);
+	list_del_rcu(&reader->node);
+	mutex_unlock(&sdev->reader_list_lock);
+	
+	//Wait for a timer callback still pushing to the ring or waking this reader
+	synchronize_rcu();
+	
+	kfree(reader->frame);
+	kfree(reader->batch);
+	kfree(reader);
+	kobject_put(&sdev->kobj);
+	
+	pr_info("nxp_simtemp: Device File Closed \n");
+	return 0;
+}
+
+//Tune the wake threshold from the reader drain rate, in the style of NAPI moderation
+static void reader_adapt(struct simtemp_reader *reader, size_t n_read)
+{
+	u32 samples = reader->wake.samples;
+	u32 samples_max = min_t(u32, WAKE_SAMPLES_MAX, READ_ONCE(reader->sdev->fifo_size) / 2);
+	
+	if(n_read >= 2 * (size_t)samples)
+	{
+		//The reader gets big batches anyway, wake it less often
+		samples = min_t(u32, 2 * samples, samples_max);
+	}
+	else if(2 * n_read < samples)
+	{
+		//Woken by the latency budget or alerts before the batch filled up
+		samples = max_t(u32, samples / 2, 1);
+	}
+	WRITE_ONCE(reader->wake.samples, samples);
+}
+
+//Copy n samples starting at pos out of the history ring, handling the wrap
+static void hist_copy(const struct hist_ring *ring, struct simtemp_sample *dst, u64 pos, unsigned int n)
+{
+	unsigned int idx = pos & (ring->size - 1);
+	unsigned int first = min_t(unsigned int, n, ring->size - idx);
+	
+	memcpy(dst, &ring->buf[idx], first * sizeof(*dst));
+	memcpy(dst + first, ring->buf, (n - first) * sizeof(*dst));
+}
+
+//Same as hist_copy() in the V2 format, the sequence number is the position
+static void hist_copy_v2(const struct hist_ring *ring, struct simtemp_sample_v2 *dst, u64 pos, unsigned int n)
+{
+	const struct simtemp_sample *src;
+	unsigned int i;
+	
+	for(i = 0; i < n; i++)
+	{
+		src = &ring->buf[(pos + i) & (ring->size - 1)];
+		dst[i].seq = pos + i;
+		dst[i].timestamp_ns = src->timestamp_ns;
+		dst[i].temp_mC = src->temp_mC;
+		dst[i].flags = src->flags;
+	}
+}
+
+//LEB128, 7 bits per byte, least significant first
+static unsigned int put_varint(u8 *dst, u64 value)
+{
+	unsigned int n = 0;
+	
+	while(value >= 0x80)
+	{
+		dst[n++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	dst[n++] = value;
+	return n;
+}
+
+//Small magnitudes of either sign give small varints
+static u64 zigzag(s64 value)
+{
+	return ((u64)value << 1) ^ (u64)(value >> 63);
+}
+
+//Encode samples into one SIMTEMP_FMT_DELTA frame of at most budget bytes (a multiple of 8)
+//Returns the samples encoded, at least the first one, and the padded frame size in *size
+static unsigned int frame_encode(u8 *dst, size_t budget, const struct simtemp_sample *src, unsigned int n, u64 seq, u32 period_us, size_t *size)
+{
+	struct simtemp_frame *frame = (struct simtemp_frame *)dst;
+	u8 *p = dst + sizeof(*frame);
+	const u8 *end = dst + budget;
+	u64 period_ns = (u64)period_us * NSEC_PER_USEC;
+	u64 ts_code;
+	unsigned int i;
+	
+	frame->seq = seq;
+	frame->base_ns = src[0].timestamp_ns;
+	frame->period_us = period_us;
+	frame->base_mC = src[0].temp_mC;
+	frame->flags = src[0].flags;
+	frame->reserved = 0;
+	for(i = 1; i < n; i++)
+	{
+		//Stop while the worst case of one more sample still fits
+		if(p + FRAME_SAMPLE_MAX > end)
+		{
+			break;
+		}
+		//Only the residual to one period is stored, a byte when phase locked and a few more of timer jitter otherwise
+		ts_code = zigzag((s64)(src[i].timestamp_ns - src[i - 1].timestamp_ns - period_ns)) << 1;
+		if(src[i].flags != src[i - 1].flags)
+		{
+			p += put_varint(p, ts_code | 1);
+			p += put_varint(p, src[i].flags);
+		}
+		else
+		{
+			p += put_varint(p, ts_code);
+		}
+		p += put_varint(p, zigzag((s64)src[i].temp_mC - src[i - 1].temp_mC));
+	}
+	frame->count = i;
+	frame->size = p - (dst + sizeof(*frame));
+	
+	//Keep the next header aligned
+	while((p - dst) % 8)
+	{
+		*p++ = 0;
+	}
+	*size = p - dst;
+	return i;
+}
+
+static ssize_t nxp_simtemp_read(struct file *file, char __user *buf, size_t len, loff_t* off)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	const struct hist_ring *ring;
+	struct simtemp_cfg cfg;
+	size_t rec_size;
+	size_t n_wanted;
+	size_t n_done = 0;
+	size_t n_out = 0;
+	unsigned int n_samples = 0;
+	unsigned int n_torn = 0;
+	unsigned int n_copied = 0;
+	size_t n_bytes = 0;
+	u64 head, pos, last_ns = 0;
+
+	//Only threads sharing this file contend here, other readers never block it
+	if(mutex_lock_interruptible(&reader->lock))
+	{
+		return -ERESTARTSYS;
+	}
+	
+	//Closed windows have their own queue
+	if(reader->format == SIMTEMP_FMT_AGG)
+	{
+		return reader_read_agg(file, reader, buf, len);
+	}
+	
+	//Only whole records are returned
+	rec_size = reader->format == SIMTEMP_FMT_V2 ? sizeof(struct simtemp_sample_v2) : sizeof(struct simtemp_sample);
+	n_wanted = len / rec_size;
+	if(reader->format == SIMTEMP_FMT_DELTA)
+	{
+		//Frames are encoded from V1 copies, as many samples as their size allows
+		n_wanted = len < sizeof(struct simtemp_frame) ? 0 : SIZE_MAX;
+		cfg_get(sdev, &cfg);
+	}
+	if(n_wanted == 0)
+	{
+		mutex_unlock(&reader->lock);
+		return -EINVAL;
+	}
+	
+	//Sleep until this file has unread samples and they meet its coalescing condition, the lock is not held meanwhile
+	//Alert edge wakeups (EPOLLPRI) fail the condition and go back to sleep
+retry:
+	while(atomic64_read(&sdev->hist_head) == reader->pos || (!(file->f_flags & O_NONBLOCK) && !reader_ready(reader)))
+	{
+		mutex_unlock(&reader->lock);
+		if(READ_ONCE(sdev->gone))
+		{
+			return -ENODEV;
+		}
+		if(file->f_flags & O_NONBLOCK)
+		{
+			return -EAGAIN;
+		}
+		if(wait_event_interruptible(reader->wq, reader_ready(reader) || READ_ONCE(sdev->gone)))
+		{
+			return -ERESTARTSYS;
+		}
+		if(mutex_lock_interruptible(&reader->lock))
+		{
+			return -ERESTARTSYS;
+		}
+	}
+
+	//Take as many samples as fit in the user buffer, one chunk at a time
+	while(n_done < n_wanted)
+	{
+		rcu_read_lock();
+		ring = rcu_dereference(sdev->hist);
+		
+		//Pairs with the release in the timer, slots up to head are complete
+		head = atomic64_read_acquire(&sdev->hist_head);
+		if(head - reader->pos > ring->size)
+		{
+			//The timer lapped this reader, skip to the oldest retained sample
+			trace_simtemp_drop(sdev->id, reader, reader->pos, head - reader->pos - ring->size);
+			atomic64_add(head - reader->pos - ring->size, &sdev->overrun);
+			reader->overrun += head - reader->pos - ring->size;
+			WRITE_ONCE(reader->pos, head - ring->size);
+		}
+		pos = reader->pos;
+		n_samples = min_t(u64, min_t(size_t, n_wanted - n_done, READ_CHUNK), head - pos);
+		if(reader->format == SIMTEMP_FMT_V2)
+		{
+			hist_copy_v2(ring, reader->batch, pos, n_samples);
+		}
+		else
+		{
+			hist_copy(ring, reader->batch, pos, n_samples);
+		}
+		
+		//The timer may have overwritten the oldest slots while they were copied
+		smp_rmb();
+		head = atomic64_read(&sdev->hist_reserve);
+		n_torn = 0;
+		if(head > pos + ring->size)
+		{
+			n_torn = min_t(u64, head - ring->size - pos, n_samples);
+		}
+		rcu_read_unlock();
+
+		if(n_samples == 0)
+		{
+			break;
+		}
+		if(n_torn)
+		{
+			trace_simtemp_drop(sdev->id, reader, pos, n_torn);
+			atomic64_add(n_torn, &sdev->overrun);
+		}
+		reader->overrun += n_torn;
+		WRITE_ONCE(reader->pos, pos + n_samples);
+		n_samples -= n_torn;
+		if(n_samples && reader->format == SIMTEMP_FMT_DELTA)
+		{
+			//One frame per chunk, the samples that do not fit stay queued for the next call
+			n_copied = n_samples;
+			n_samples = frame_encode(reader->frame, min_t(size_t, FRAME_BYTES, (len - n_out) & ~(size_t)7),
+				(struct simtemp_sample *)reader->batch + n_torn, n_samples, pos + n_torn, cfg.sampling_us, &n_bytes);
+			WRITE_ONCE(reader->pos, pos + n_torn + n_samples);
+			last_ns = ((struct simtemp_sample *)reader->batch)[n_torn + n_samples - 1].timestamp_ns;
+			if (copy_to_user((void __user *)buf + n_out, reader->frame, n_bytes))
+			{
+				mutex_unlock(&reader->lock);
+				pr_warn("nxp_simtemp: Failed to copy data to user space\n");
+				return -EFAULT;
+			}
+			n_out += n_bytes;
+			n_done += n_samples;
+			if(n_samples < n_copied || len - n_out < sizeof(struct simtemp_frame))
+			{
+				break;
+			}
+			continue;
+		}
+		if(n_samples && reader->format == SIMTEMP_FMT_V2)
+		{
+			last_ns = ((struct simtemp_sample_v2 *)reader->batch)[n_torn + n_samples - 1].timestamp_ns;
+		}
+		else if(n_samples)
+		{
+			last_ns = ((struct simtemp_sample *)reader->batch)[n_torn + n_samples - 1].timestamp_ns;
+		}
+
+		//The user copy may fault, so it is done out of the RCU section
+		n_bytes = n_samples * rec_size;
+		if (copy_to_user((void __user *)buf + n_out, (u8 *)reader->batch + n_torn * rec_size, n_bytes))
+		{
+			mutex_unlock(&reader->lock);
+			pr_warn("nxp_simtemp: Failed to copy data to user space\n");
+			return -EFAULT;
+		}
+		n_out += n_bytes;
+		n_done += n_samples;
+	}
+	//Every copied sample was overwritten meanwhile, 0 would mean end of file
+	if(n_done == 0)
+	{
+		goto retry;
+	}
+	if(READ_ONCE(reader->wake.adaptive))
+	{
+		reader_adapt(reader, n_done);
+	}
+	if(trace_simtemp_read_enabled())
+	{
+		//Age of the newest returned sample, the end to end latency of this read
+		trace_simtemp_read(sdev->id, reader, n_done, reader->overrun, ktime_get_real_ns() - last_ns);
+	}
+	mutex_unlock(&reader->lock);
+
+	return n_out;
+}
+
+//read() of SIMTEMP_FMT_AGG, called with reader->lock held and releases it
+static ssize_t reader_read_agg(struct file *file, struct simtemp_reader *reader, char __user *buf, size_t len)
+{
+	struct simtemp_dev *sdev = reader->sdev;
+	unsigned int copied = 0;
+	int ret = 0;
+	
+	//Only whole records are returned
+	if(len < sizeof(struct simtemp_agg))
+	{
+		mutex_unlock(&reader->lock);
+		return -EINVAL;
+	}
+	
+	//Sleep until the producer closes a window, the lock is not held meanwhile
+	while(kfifo_is_empty(&reader->aggs))
+	{
+		mutex_unlock(&reader->lock);
+		if(READ_ONCE(sdev->gone))
+		{
+			return -ENODEV;
+		}
+		if(file->f_flags & O_NONBLOCK)
+		{
+			return -EAGAIN;
+		}
+		if(wait_event_interruptible(reader->wq, !kfifo_is_empty(&reader->aggs) || READ_ONCE(reader->format) != SIMTEMP_FMT_AGG || READ_ONCE(sdev->gone)))
+		{
+			return -ERESTARTSYS;
+		}
+		if(mutex_lock_interruptible(&reader->lock))
+		{
+			return -ERESTARTSYS;
+		}
+		//Another thread switched the format while this one slept
+		if(reader->format != SIMTEMP_FMT_AGG)
+		{
+			mutex_unlock(&reader->lock);
+			return nxp_simtemp_read(file, buf, len, NULL);
+		}
+	}
+	
+	//Single consumer under reader->lock, the user copy may fault
+	ret = kfifo_to_user(&reader->aggs, buf, len - len % sizeof(struct simtemp_agg), &copied);
+	mutex_unlock(&reader->lock);
+	
+	return ret ? ret : copied;
+}
+
+//Upload the waveform of MODE_RPL, a struct simtemp_wave followed by its values in one call
+static ssize_t nxp_simtemp_write(struct file *file, const char __user *buf, size_t len, loff_t* off)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	struct wave_table *wave, *old_wave;
+	struct simtemp_wave hdr;
+	unsigned long flags;
+	__u8 error = E_NO_ERR;
+	u32 i;
+	
+	if(len < sizeof(hdr))
+	{
+		error = E_EV_WV;
+		goto r_inval;
+	}
+	if(copy_from_user(&hdr, buf, sizeof(hdr)))
+	{
+		return -EFAULT;
+	}
+	//The whole table comes in one write(), a short one would be played as if complete
+	if(hdr.count == 0 || hdr.count > SIMTEMP_WAVE_MAX || (hdr.flags & ~SIMTEMP_WAVE_LOOP) ||
+		len != sizeof(hdr) + (size_t)hdr.count * sizeof(s32))
+	{
+		error = E_EV_WV;
+		goto r_inval;
+	}
+	
+	//Up to 4 MiB of values, kmalloc may not have them contiguous
+	wave = kvmalloc(struct_size(wave, temp_mC, hdr.count), GFP_KERNEL);
+	if(!wave)
+	{
+		return -ENOMEM;
+	}
+	if(copy_from_user(wave->temp_mC, buf + sizeof(hdr), hdr.count * sizeof(s32)))
+	{
+		kvfree(wave);
+		return -EFAULT;
+	}
+	//Validated once here, playback costs one load per sample
+	for(i = 0; i < hdr.count; i++)
+	{
+		if(wave->temp_mC[i] > TEMP_MAX || wave->temp_mC[i] < TEMP_MIN)
+		{
+			kvfree(wave);
+			error = E_OR_WV;
+			goto r_inval;
+		}
+	}
+	wave->count = hdr.count;
+	wave->flags = hdr.flags;
+	
+	mutex_lock(&sdev->cfg_lock);
+	if(READ_ONCE(sdev->gone))
+	{
+		mutex_unlock(&sdev->cfg_lock);
+		kvfree(wave);
+		return -ENODEV;
+	}
+	wave->gen = ++sdev->wave_gen;
+	old_wave = rcu_dereference_protected(sdev->wave, lockdep_is_held(&sdev->cfg_lock));
+	rcu_assign_pointer(sdev->wave, wave);
+	mutex_unlock(&sdev->cfg_lock);
+	
+	//The producer may still be playing the old table
+	synchronize_rcu();
+	kvfree(old_wave);
+	pr_info("nxp_simtemp: simtemp%d waveform of %u samples, %s\n",sdev->id,hdr.count,(hdr.flags & SIMTEMP_WAVE_LOOP) ? "looped" : "one-shot");
+	
+	return len;
+	
+r_inval:
+	spin_lock_irqsave(&sdev->flags_lock,flags);
+	sdev->e_flags.l_error = error;
+	spin_unlock_irqrestore(&sdev->flags_lock,flags);
+	return -EINVAL;
+}
+
+static unsigned int nxp_simtemp_poll(struct file *file, poll_table *wait)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	unsigned int mask = 0;
+	
+	poll_wait(file,&reader->wq,wait);
+	
+	if(READ_ONCE(sdev->gone))
+	{
+		return POLLERR | POLLHUP;
+	}
+	
+	//Alert edges are signalled apart from the data, whatever the format or access
+	if(!kfifo_is_empty(&reader->events))
+	{
+		mask |= POLLPRI;
+	}
+	
+	//mmap consumers only care about their own ring
+	if(READ_ONCE(sdev->ring_owner) == file)
+	{
+		if(READ_ONCE(sdev->ring_ctrl->data_head) != READ_ONCE(sdev->ring_ctrl->data_tail))
+		{
+			mask |= POLLIN | POLLRDNORM;
+		}
+		return mask;
+	}
+	
+	if(READ_ONCE(reader->format) == SIMTEMP_FMT_AGG)
+	{
+		if(!kfifo_is_empty(&reader->aggs))
+		{
+			mask |= POLLIN | POLLRDNORM;
+		}
+		return mask;
+	}
+	
+	if(reader_ready(reader))
+	{
+		mask |= POLLIN | POLLRDNORM;
+	}
+	
+	return mask;
+}
+
+static long nxp_simtemp_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	struct simtemp_status status;
+	struct simtemp_wake wake;
+	struct simtemp_window window;
+	struct simtemp_event event;
+	u64 overrun;
+	u32 format, lowat;
+	int ret = 0;
+	
+	switch(cmd)
+	{
+		case SIMTEMP_IOC_GET_OVERRUN:
+			mutex_lock(&reader->lock);
+			overrun = reader->overrun;
+			mutex_unlock(&reader->lock);
+			if(copy_to_user((void __user *)arg, &overrun, sizeof(overrun)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		case SIMTEMP_IOC_SET_WAKE:
+			if(copy_from_user(&wake, (void __user *)arg, sizeof(wake)))
+			{
+				return -EFAULT;
+			}
+			if(wake.samples == 0 || wake.samples > WAKE_SAMPLES_MAX || wake.latency_us > TIME_MAX_us)
+			{
+				return -EINVAL;
+			}
+			mutex_lock(&reader->lock);
+			WRITE_ONCE(reader->wake.samples, wake.samples);
+			WRITE_ONCE(reader->wake.latency_us, wake.latency_us);
+			WRITE_ONCE(reader->wake.adaptive, !!wake.adaptive);
+			mutex_unlock(&reader->lock);
+			return 0;
+		case SIMTEMP_IOC_GET_WAKE:
+			mutex_lock(&reader->lock);
+			wake = reader->wake;
+			mutex_unlock(&reader->lock);
+			if(copy_to_user((void __user *)arg, &wake, sizeof(wake)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		case SIMTEMP_IOC_SET_LOWAT:
+			if(get_user(lowat, (__u32 __user *)arg))
+			{
+				return -EFAULT;
+			}
+			if(lowat == 0 || lowat > WAKE_SAMPLES_MAX)
+			{
+				return -EINVAL;
+			}
+			//Same threshold as simtemp_wake.samples, fixed from now on
+			mutex_lock(&reader->lock);
+			WRITE_ONCE(reader->wake.samples, lowat);
+			WRITE_ONCE(reader->wake.adaptive, 0);
+			mutex_unlock(&reader->lock);
+			return 0;
+		case SIMTEMP_IOC_GET_LOWAT:
+			return put_user(READ_ONCE(reader->wake.samples), (__u32 __user *)arg);
+		case SIMTEMP_IOC_GET_CONFIG:
+			simtemp_get_status(sdev, &status);
+			if(copy_to_user((void __user *)arg, &status, sizeof(status)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		case SIMTEMP_IOC_SET_CONFIG:
+			if(copy_from_user(&status, (void __user *)arg, sizeof(status)))
+			{
+				return -EFAULT;
+			}
+			ret = simtemp_set_config(sdev, &status.config);
+			if(ret)
+			{
+				return ret;
+			}
+			simtemp_get_status(sdev, &status);
+			if(copy_to_user((void __user *)arg, &status, sizeof(status)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		case SIMTEMP_IOC_SET_FORMAT:
+			if(get_user(format, (__u32 __user *)arg))
+			{
+				return -EFAULT;
+			}
+			if(format != SIMTEMP_FMT_V1 && format != SIMTEMP_FMT_V2 && format != SIMTEMP_FMT_AGG && format != SIMTEMP_FMT_DELTA)
+			{
+				return -EINVAL;
+			}
+			//Serialized with read(), a call never mixes formats
+			mutex_lock(&reader->lock);
+			if(format == SIMTEMP_FMT_DELTA && !reader->frame)
+			{
+				reader->frame = kmalloc(FRAME_BYTES, GFP_KERNEL);
+				if(!reader->frame)
+				{
+					mutex_unlock(&reader->lock);
+					return -ENOMEM;
+				}
+			}
+			if(format == SIMTEMP_FMT_AGG && reader->format != SIMTEMP_FMT_AGG)
+			{
+				//The producer is not folding for this file, the queue is safe to empty from here
+				kfifo_reset_out(&reader->aggs);
+				set_bit(0, &reader->agg_reset);
+			}
+			else if(format != SIMTEMP_FMT_AGG && reader->format == SIMTEMP_FMT_AGG)
+			{
+				//Raw records start again with the next generated sample
+				WRITE_ONCE(reader->pos, atomic64_read(&sdev->hist_head));
+				reader->woken_pos = U64_MAX;
+			}
+			WRITE_ONCE(reader->format, format);
+			mutex_unlock(&reader->lock);
+			return 0;
+		case SIMTEMP_IOC_GET_FORMAT:
+			mutex_lock(&reader->lock);
+			format = reader->format;
+			mutex_unlock(&reader->lock);
+			return put_user(format, (__u32 __user *)arg);
+		case SIMTEMP_IOC_SET_WINDOW:
+			if(copy_from_user(&window, (void __user *)arg, sizeof(window)))
+			{
+				return -EFAULT;
+			}
+			if((window.samples == 0 && window.time_us == 0) || window.samples > WINDOW_SAMPLES_MAX || window.time_us > TIME_MAX_us)
+			{
+				return -EINVAL;
+			}
+			//The producer drops the open window on its next expiry, closed ones stay queued
+			mutex_lock(&reader->lock);
+			WRITE_ONCE(reader->window.samples, window.samples);
+			WRITE_ONCE(reader->window.time_us, window.time_us);
+			set_bit(0, &reader->agg_reset);
+			mutex_unlock(&reader->lock);
+			return 0;
+		case SIMTEMP_IOC_GET_WINDOW:
+			mutex_lock(&reader->lock);
+			window = reader->window;
+			mutex_unlock(&reader->lock);
+			if(copy_to_user((void __user *)arg, &window, sizeof(window)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		case SIMTEMP_IOC_GET_EVENT:
+			//Single consumer under reader->lock, the producer fills the queue without locking
+			mutex_lock(&reader->lock);
+			ret = kfifo_get(&reader->events, &event);
+			mutex_unlock(&reader->lock);
+			if(!ret)
+			{
+				return READ_ONCE(sdev->gone) ? -ENODEV : -EAGAIN;
+			}
+			if(copy_to_user((void __user *)arg, &event, sizeof(event)))
+			{
+				return -EFAULT;
+			}
+			return 0;
+		default:
+			return -ENOTTY;
+	}
+}
+
+static int nxp_simtemp_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct simtemp_reader *reader = file->private_data;
+	struct simtemp_dev *sdev = reader->sdev;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret = 0;
+	
+	//The whole ring is mapped at once and the consumer writes data_tail
+	if(vma->vm_pgoff != 0 || size != RING_BYTES || !(vma->vm_flags & VM_SHARED))
+	{
+		return -EINVAL;
+	}
+	
+	mutex_lock(&sdev->ring_lock);
+	if(sdev->ring_owner && sdev->ring_owner != file)
+	{
+		mutex_unlock(&sdev->ring_lock);
+		pr_info("nxp_simtemp: mmap ring already in use\n");
+		return -EBUSY;
+	}
+	
+	ret = remap_vmalloc_range(vma, sdev->ring_ctrl, 0);
+	if(!ret && !sdev->ring_owner)
+	{
+		//A new consumer starts with an empty ring
+		sdev->ring_ctrl->data_head = 0;
+		sdev->ring_ctrl->data_tail = 0;
+		sdev->ring_ctrl->lost = 0;
+		smp_wmb();
+		WRITE_ONCE(sdev->ring_owner, file);
+	}
+	mutex_unlock(&sdev->ring_lock);
+	
+	return ret;
+}
+
+//Push a batch of the history ring to the mmap ring, single producer (timer callback)
+static void ring_push(struct simtemp_dev *sdev, const struct hist_ring *ring, u64 first, u32 n)
+{
+	struct simtemp_ring_ctrl *ring_ctrl = sdev->ring_ctrl;
+	u64 head = ring_ctrl->data_head;
+	u64 tail = READ_ONCE(ring_ctrl->data_tail);
+	u32 n_lost = 0, n_room, i;
+	
+	//Pairs with the consumer barrier before it writes data_tail
+	smp_mb();
+	
+	//A batch longer than the history ring already overwrote its oldest samples
+	if(n > ring->size)
+	{
+		n_lost = n - ring->size;
+		first += n_lost;
+		n = ring->size;
+	}
+	n_room = sdev->ring_mask + 1 - (u32)(head - tail);
+	if(n > n_room)
+	{
+		n_lost += n - n_room;
+		n = n_room;
+	}
+	if(n_lost)
+	{
+		WRITE_ONCE(ring_ctrl->lost, ring_ctrl->lost + n_lost);
+		atomic64_add(n_lost, &sdev->overrun);
+		trace_simtemp_drop(sdev->id, NULL, head, n_lost);
+	}
+	for(i = 0; i < n; i++)
+	{
+		sdev->ring_data[(head + i) & sdev->ring_mask] = ring->buf[(first + i) & (ring->size - 1)];
+	}
+	
+	//The samples must be visible before the new head
+	smp_wmb();
+	WRITE_ONCE(ring_ctrl->data_head, head + n);
+}
+
+//Whether pending samples reach the low-water mark, the latency budget or include an alert
+static bool reader_due(struct simtemp_reader *reader, u64 pending, u64 now_ns, u64 since_ns, bool alert)
+{
+	u32 latency_us = READ_ONCE(reader->wake.latency_us);
+	
+	if(alert || pending >= READ_ONCE(reader->wake.samples))
+	{
+		return true;
+	}
+	return latency_us && now_ns - since_ns >= (u64)latency_us * NSEC_PER_USEC;
+}
+
+//Unread samples that meet the coalescing condition, the readiness of poll() and of a blocking read()
+//Lockless check against the low-water mark, a stale position only delays readiness to the next wakeup
+static bool reader_ready(struct simtemp_reader *reader)
+{
+	struct simtemp_dev *sdev = reader->sdev;
+	u64 head, pos, now_ns, since_ns;
+	
+	pos = READ_ONCE(reader->pos);
+	head = atomic64_read(&sdev->hist_head);
+	if(head == pos)
+	{
+		return false;
+	}
+	now_ns = ktime_get_ns();
+	//The budget of samples queued after the last tick starts now
+	since_ns = READ_ONCE(reader->wake_pos) == pos ? READ_ONCE(reader->pending_since) : now_ns;
+	return reader_due(reader, head - pos, now_ns, since_ns, atomic64_read(&sdev->alert_head) > pos);
+}
+
+//Queue the open window of a reader, a full queue drops it
+static void reader_agg_close(struct simtemp_reader *reader)
+{
+	if(!kfifo_put(&reader->aggs, reader->agg))
+	{
+		atomic64_add(reader->agg.count, &reader->sdev->overrun);
+		trace_simtemp_drop(reader->sdev->id, reader, reader->agg.seq, reader->agg.count);
+	}
+	reader->agg.count = 0;
+}
+
+//Fold a published batch into the open window of a SIMTEMP_FMT_AGG reader, called from the producer
+static void reader_fold(struct simtemp_reader *reader, const struct hist_ring *ring, u64 first, u32 n)
+{
+	struct simtemp_agg *agg = &reader->agg;
+	const struct simtemp_sample *sample;
+	u32 samples = READ_ONCE(reader->window.samples);
+	u64 time_ns = (u64)READ_ONCE(reader->window.time_us) * NSEC_PER_USEC;
+	bool closed = false;
+	u64 pos;
+	
+	//One atomic step, a request made meanwhile is not lost
+	if(test_and_clear_bit(0, &reader->agg_reset))
+	{
+		agg->count = 0;
+	}
+	
+	//A batch longer than the history ring already overwrote its oldest samples
+	if(n > ring->size)
+	{
+		first += n - ring->size;
+		n = ring->size;
+	}
+	for(pos = first; pos < first + n; pos++)
+	{
+		sample = &ring->buf[pos & (ring->size - 1)];
+		
+		//Time windows are aligned to multiples of their length, the first sample past the end closes them
+		if(agg->count && time_ns && sample->timestamp_ns >= reader->agg_end_ns)
+		{
+			reader_agg_close(reader);
+			closed = true;
+		}
+		if(agg->count == 0)
+		{
+			agg->seq = pos;
+			agg->start_ns = sample->timestamp_ns;
+			agg->alerts = 0;
+			agg->min_mC = sample->temp_mC;
+			agg->max_mC = sample->temp_mC;
+			agg->sum_mC = 0;
+			agg->sum_sq = 0;
+			if(time_ns)
+			{
+				reader->agg_end_ns = (div64_u64(sample->timestamp_ns, time_ns) + 1) * time_ns;
+			}
+		}
+		agg->count++;
+		agg->end_ns = sample->timestamp_ns;
+		agg->min_mC = min(agg->min_mC, sample->temp_mC);
+		agg->max_mC = max(agg->max_mC, sample->temp_mC);
+		agg->sum_mC += sample->temp_mC;
+		agg->sum_sq += (s64)sample->temp_mC * sample->temp_mC;
+		if(sample->flags & FLAG_THRESHOLD_CROSSED)
+		{
+			agg->alerts++;
+		}
+		if(samples && agg->count >= samples)
+		{
+			reader_agg_close(reader);
+			closed = true;
+		}
+	}
+	
+	//One wakeup per expiry that closed a window, whatever the wake settings
+	if(closed && wq_has_sleeper(&reader->wq))
+	{
+		trace_simtemp_wake(reader->sdev->id, reader, kfifo_len(&reader->aggs), false);
+		wake_up_interruptible(&reader->wq);
+	}
+}
+
+//Wake a reader once its coalescing condition is met, called from the timer
+static void reader_wake(struct simtemp_reader *reader, u64 head, u32 n_new, u64 now_ns, bool alert)
+{
+	u64 pos, pending;
+	struct simtemp_dev *sdev = reader->sdev;
+	
+	//mmap consumers are woken on their own ring occupancy
+	if(READ_ONCE(sdev->ring_owner) == reader->file)
+	{
+		pos = READ_ONCE(sdev->ring_ctrl->data_tail);
+		head = READ_ONCE(sdev->ring_ctrl->data_head);
+	}
+	else
+	{
+		pos = READ_ONCE(reader->pos);
+	}
+	pending = head - pos;
+	if(pending == 0)
+	{
+		return;
+	}
+	
+	//Restart the latency budget when the reader consumed or the queue was empty
+	if(pos != reader->wake_pos || pending <= n_new)
+	{
+		WRITE_ONCE(reader->pending_since, now_ns);
+		WRITE_ONCE(reader->wake_pos, pos);
+	}
+	
+	if(!reader_due(reader, pending, now_ns, reader->pending_since, alert))
+	{
+		return;
+	}
+	
+	//One wakeup per readiness edge, the next one once the reader consumed, as EPOLLET expects
+	if(pos == reader->woken_pos && !alert)
+	{
+		return;
+	}
+	
+	if(wq_has_sleeper(&reader->wq))
+	{
+		reader->woken_pos = pos;
+		trace_simtemp_wake(sdev->id, reader, pending, alert);
+		wake_up_interruptible(&reader->wq);
+	}
+}
+
+//Next value of the uploaded waveform into current_sample, called from the producer under RCU
+static void simtemp_replay(struct simtemp_dev *sdev, struct simtemp_sample *current_sample)
+{
+	const struct wave_table *wave = rcu_dereference(sdev->wave);
+	
+	//Nothing uploaded yet, the temperature is held
+	if(!wave)
+	{
+		return;
+	}
+	//A new upload or entering the mode again plays from the start
+	if(wave->gen != sdev->wave_seen)
+	{
+		sdev->wave_seen = wave->gen;
+		sdev->wave_pos = 0;
+	}
+	if(sdev->wave_pos == wave->count)
+	{
+		if(!(wave->flags & SIMTEMP_WAVE_LOOP))
+		{
+			return;
+		}
+		sdev->wave_pos = 0;
+	}
+	current_sample->temp_mC = wave->temp_mC[sdev->wave_pos++];
+}
+
+//Generate the next sample of the selected mode into current_sample, returns whether the alert state changed
+static bool simtemp_generate(struct simtemp_dev *sdev, const struct simtemp_cfg *cfg, u64 timestamp_ns)
+{
+	struct simtemp_sample *current_sample = &sdev->current_sample;
+	bool active;
+	
+	if(cfg->mode == MODE_NRM || cfg->mode == MODE_NSY)
+	{
+		//Reseeded at a sample boundary, the first sample after the write takes the first draw
+		if(sdev->rng_gen != cfg->seed_gen)
+		{
+			gaussian_rng_seed(&sdev->rng, cfg->seed);
+			sdev->rng_gen = cfg->seed_gen;
+		}
+		current_sample->temp_mC = gaussian_s32_icdf_rng(&sdev->rng, TEMP_MEAN_mC, cfg->TEMP_STD_mC);
+	}
+	else if(cfg->mode == MODE_RPL)
+	{
+		simtemp_replay(sdev, current_sample);
+	}
+	else
+	{
+		current_sample->temp_mC = ((current_sample->temp_mC + 1000 - TEMP_MIN) % (TEMP_MAX - TEMP_MIN + 1)) + TEMP_MIN;
+	}
+	if(cfg->mode != MODE_RPL)
+	{
+		sdev->wave_seen = 0;
+	}
+	current_sample->timestamp_ns = timestamp_ns;
+	current_sample->flags = FLAG_NEW_SAMPLE;
+	
+	//Asserted above threshold_mC, cleared only at or below threshold_mC - hysteresis_mC
+	if(sdev->alert_active)
+	{
+		active = current_sample->temp_mC > cfg->threshold_mC - (s32)cfg->hysteresis_mC;
+	}
+	else
+	{
+		active = current_sample->temp_mC > cfg->threshold_mC;
+	}
+	if (active)
+	{
+		current_sample->flags |= FLAG_THRESHOLD_CROSSED; 
+	}
+	trace_simtemp_sample(sdev->id, cfg->mode, current_sample->temp_mC, current_sample->flags);
+	
+	if(active == sdev->alert_active)
+	{
+		return false;
+	}
+	sdev->alert_active = active;
+	return true;
+}
+
+//Queue the alert edge of the sample at pos for every open file, called from the producer under RCU
+static void simtemp_push_event(struct simtemp_dev *sdev, const struct simtemp_cfg *cfg, u64 pos)
+{
+	const struct simtemp_sample *current_sample = &sdev->current_sample;
+	struct simtemp_reader *reader;
+	struct simtemp_event event = {
+		.seq = pos,
+		.timestamp_ns = current_sample->timestamp_ns,
+		.temp_mC = current_sample->temp_mC,
+	};
+	
+	if(sdev->alert_active)
+	{
+		event.type = SIMTEMP_EVENT_ASSERT;
+		event.threshold_mC = cfg->threshold_mC;
+	}
+	else
+	{
+		event.type = SIMTEMP_EVENT_CLEAR;
+		event.threshold_mC = cfg->threshold_mC - (s32)cfg->hysteresis_mC;
+	}
+	
+	//Edges are rare next to samples, every file gets its own copy
+	list_for_each_entry_rcu(reader, &sdev->reader_list, node)
+	{
+		event.lost = reader->events_lost;
+		if(kfifo_put(&reader->events, event))
+		{
+			reader->events_lost = 0;
+			reader->events_new = true;
+		}
+		else
+		{
+			reader->events_lost++;
+		}
+	}
+}
+
+static void timer_hist_add(struct timer_hist *h, u64 ns)
+{
+	h->bucket[fls64(ns)]++;
+	h->count++;
+	h->min_ns = min(h->min_ns, ns);
+	h->max_ns = max(h->max_ns, ns);
+}
+
+//Generate one expiry worth of samples, publish them and wake the readers. Callers hold the RCU read lock
+static void simtemp_produce(struct simtemp_dev *sdev, const struct simtemp_cfg *cfg, u64 now_ns, u64 expires_ns, u64 real_ns)
+{
+	struct simtemp_sample *current_sample = &sdev->current_sample;
+	struct simtemp_pcpu_stats *stats;
+	struct simtemp_reader *reader;
+	struct hist_ring *ring;
+	u64 head, step_ns;
+	u32 batch = cfg->batch;
+	u32 i, n_alerts = 0, last_alert = 0;
+	
+	//Samples of a batch are spread evenly over the period, the last one is taken at real_ns
+	step_ns = (u64)cfg->sampling_us * NSEC_PER_USEC;
+	
+	//Overwrite the oldest slots without locking, single producer
+	ring = rcu_dereference(sdev->hist);
+	head = atomic64_read(&sdev->hist_head);
+	//Claim the batch before the slots change, readers validate their copy against it
+	atomic64_set(&sdev->hist_reserve, head + batch);
+	smp_wmb();
+	for(i = 0; i < batch; i++)
+	{
+		if(simtemp_generate(sdev, cfg, real_ns - (u64)(batch - 1 - i) * step_ns))
+		{
+			simtemp_push_event(sdev, cfg, head + i);
+		}
+		ring->buf[(head + i) & (ring->size - 1)] = *current_sample;
+		if(current_sample->flags & FLAG_THRESHOLD_CROSSED)
+		{
+			n_alerts++;
+			last_alert = i + 1;
+		}
+	}
+	if(n_alerts)
+	{
+		atomic64_set(&sdev->alert_head, head + last_alert);
+	}
+	//The slots must be complete before they are published, one update per batch
+	atomic64_set_release(&sdev->hist_head, head + batch);
+	
+	if(READ_ONCE(sdev->ring_owner))
+	{
+		ring_push(sdev, ring, head, batch);
+	}
+	if(trace_simtemp_enqueue_enabled())
+	{
+		trace_simtemp_enqueue(sdev->id, head + batch, batch, min_t(u64, head + batch, ring->size), ring->size,
+			READ_ONCE(sdev->ring_owner) ? (u32)(sdev->ring_ctrl->data_head - READ_ONCE(sdev->ring_ctrl->data_tail)) : 0);
+	}
+	
+	//Only the producer of this instance writes its counters, the thread may migrate between two updates
+	stats = get_cpu_ptr(sdev->stats);
+	u64_stats_update_begin(&stats->syncp);
+	stats->counter += batch;
+	stats->alert += n_alerts;
+	u64_stats_update_end(&stats->syncp);
+	put_cpu_ptr(sdev->stats);
+	
+	//Only wake the readers whose batch or latency budget is due, aggregating readers get closed windows
+	list_for_each_entry_rcu(reader, &sdev->reader_list, node)
+	{
+		//One keyed wakeup per expiry with new edges, for pollers of POLLPRI
+		if(reader->events_new)
+		{
+			reader->events_new = false;
+			wake_up_interruptible_poll(&reader->wq, EPOLLPRI);
+		}
+		if(READ_ONCE(reader->format) == SIMTEMP_FMT_AGG)
+		{
+			reader_fold(reader, ring, head, batch);
+		}
+		else
+		{
+			reader_wake(reader, head + batch, batch, now_ns, n_alerts != 0);
+		}
+	}
+	
+	//Lateness against the programmed expiry, cost up to here. The generation thread is preemptible, a reader must not spin on it
+	preempt_disable();
+	write_seqcount_begin(&sdev->timer_seq);
+	if(READ_ONCE(sdev->timer_hist_reset))
+	{
+		memset(&sdev->lateness, 0, sizeof(sdev->lateness));
+		memset(&sdev->cost, 0, sizeof(sdev->cost));
+		sdev->lateness.min_ns = U64_MAX;
+		sdev->cost.min_ns = U64_MAX;
+		WRITE_ONCE(sdev->timer_hist_reset, false);
+	}
+	timer_hist_add(&sdev->lateness, now_ns > expires_ns ? now_ns - expires_ns : 0);
+	timer_hist_add(&sdev->cost, ktime_get_ns() - now_ns);
+	write_seqcount_end(&sdev->timer_seq);
+	preempt_enable();
+}
+
+//Wall clock time of the newest sample of an expiry
+static u64 simtemp_timestamp(struct hrtimer *timer, const struct simtemp_cfg *cfg)
+{
+	if(cfg->phase_lock)
+	{
+		//The grid point, so the lateness of the expiry does not show in the timestamps
+		return ktime_to_ns(ktime_mono_to_real(hrtimer_get_expires(timer)));
+	}
+	return ktime_get_real_ns();
+}
+
+//Re-arm the timer, a period change applies from here on without a gap or a burst
+static void simtemp_timer_forward(struct hrtimer *timer, const struct simtemp_cfg *cfg, u64 now_ns)
+{
+	if(cfg->phase_lock)
+	{
+		//Late or missed expiries never shift the grid, so long captures do not drift
+		hrtimer_set_expires(timer, simtemp_grid_next(now_ns, cfg->kt_period));
+	}
+	else
+	{
+		hrtimer_forward_now(timer,cfg->kt_period);
+	}
+}
+
+//Hard or soft interrupt context, the whole expiry is handled here
+static enum hrtimer_restart timer_callback(struct hrtimer *timer)
+{
+	struct simtemp_dev *sdev = container_of(timer, struct simtemp_dev, timer);
+	const struct simtemp_cfg *cfg;
+	u64 now_ns = ktime_to_ns(hrtimer_cb_get_time(timer));
+	
+	rcu_read_lock();
+	//One consistent configuration for the whole expiry
+	cfg = rcu_dereference(sdev->cfg);
+	simtemp_produce(sdev, cfg, now_ns, hrtimer_get_expires_ns(timer), simtemp_timestamp(timer, cfg));
+	simtemp_timer_forward(timer, cfg, now_ns);
+	rcu_read_unlock();
+	
+	return HRTIMER_RESTART;
+}
+
+//Thread context: the hard interrupt only timestamps the expiry and wakes the generation thread
+static enum hrtimer_restart timer_callback_thread(struct hrtimer *timer)
+{
+	struct simtemp_dev *sdev = container_of(timer, struct simtemp_dev, timer);
+	const struct simtemp_cfg *cfg;
+	struct simtemp_tick tick;
+	u64 now_ns = ktime_to_ns(hrtimer_cb_get_time(timer));
+	
+	rcu_read_lock();
+	cfg = rcu_dereference(sdev->cfg);
+	tick.expires_ns = hrtimer_get_expires_ns(timer);
+	tick.real_ns = simtemp_timestamp(timer, cfg);
+	//Single producer and single consumer, kfifo needs no lock
+	if(!kfifo_put(&sdev->ticks, tick))
+	{
+		//The thread is starved, this expiry is never generated
+		atomic64_add(cfg->batch, &sdev->overrun);
+	}
+	wake_up_process(sdev->gen_thread);
+	simtemp_timer_forward(timer, cfg, now_ns);
+	rcu_read_unlock();
+	
+	return HRTIMER_RESTART;
+}
+
+//Generation thread, always created so switching contexts never allocates
+static int simtemp_gen_thread(void *data)
+{
+	struct simtemp_dev *sdev = data;
+	struct simtemp_tick tick;
+	
+	for(;;)
+	{
+		set_current_state(TASK_INTERRUPTIBLE);
+		//Queued expiries are generated before parking or stopping
+		if(kfifo_is_empty(&sdev->ticks))
+		{
+			if(kthread_should_stop())
+			{
+				__set_current_state(TASK_RUNNING);
+				break;
+			}
+			if(kthread_should_park())
+			{
+				__set_current_state(TASK_RUNNING);
+				kthread_parkme();
+				continue;
+			}
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+		
+		while(kfifo_get(&sdev->ticks, &tick))
+		{
+			rcu_read_lock();
+			simtemp_produce(sdev, rcu_dereference(sdev->cfg), ktime_get_ns(), tick.expires_ns, tick.real_ns);
+			rcu_read_unlock();
+		}
+	}
+	return 0;
+}
+
+static int __init nxp_simtemp_init(void)
+{
+	struct platform_device *pdev;
+	struct device_node *np;
+	bool dt_nodes = false;
+	unsigned int i;
+	
+	//Depth of the history ring of every instance without a fifo-size property
+	if(fifo_size > FIFO_SIZE_MAX || fifo_size < FIFO_SIZE_MIN)
+	{
+		pr_info("nxp_simtemp: fifo_size out of range, using %u\n",FIFO_SIZE);
+		fifo_size = FIFO_SIZE;
+	}
+	fifo_size = roundup_pow_of_two(fifo_size);
+	
+	//Allocate Major Number, one minor per instance
+	if((alloc_chrdev_region(&dev, 0, SIMTEMP_MAX_DEVICES,"simtemp"))<0)
+	{
+		pr_info("nxp_simtemp: Cannot allocate major number\n");
+		return -1;
+	}
+	pr_info("nxp_simtemp: Major = %d Minor = %d \n", MAJOR(dev),MINOR(dev));
+	
+	//Create struct class
+	if(IS_ERR(dev_class = class_create(THIS_MODULE,"simtemp")))
+	{
+		pr_info("nxp_simtemp: Cannot create the struct class\n");
+		goto r_class;
+	}
+	
+	//Create a directory in /sys/kernel/, instances add theirs below it
+	kobj_ref = kobject_create_and_add("simtemp",kernel_kobj);
+	if(!kobj_ref)
+	{
+		pr_err("Cannot create kobject\n");
+		goto r_kobj;
+	}
+	
+	//Parent of the debugfs directory of every instance
+	debugfs_root = debugfs_create_dir("simtemp", NULL);
+	
+	// Load the driver, every nxp,simtemp node is probed here
+	if(platform_driver_register(&nxp_simtemp_driver))
+	{
+		pr_info("nxp_simtemp: Error.Could not load the driver\n");
+		goto r_driver;
+	}
+	
+	//Without an enabled DT node, create the requested number of instances, disabled nodes are never probed
+	for_each_compatible_node(np, NULL, "nxp,simtemp")
+	{
+		if(of_device_is_available(np))
+		{
+			//The iterator only drops the reference when it moves on
+			of_node_put(np);
+			dt_nodes = true;
+			break;
+		}
+	}
+	if(!dt_nodes)
+	{
+		for(i = 0; i < min_t(unsigned int, nr_devices, SIMTEMP_MAX_DEVICES); i++)
+		{
+			pdev = platform_device_register_simple(nxp_simtemp_driver.driver.name, i, NULL, 0);
+			if(IS_ERR(pdev))
+			{
+				pr_err("nxp_simtemp: Cannot register device %u\n",i);
+				break;
+			}
+			fallback_pdevs[i] = pdev;
+		}
+	}
+	
+	pr_info("nxp_simtemp: Device Driver Insert Done\n");
+	return 0;
+
+r_driver:
+	debugfs_remove_recursive(debugfs_root);
 	kobject_put(kobj_ref);
-	return -ENOMEM;
-r_device:
+r_kobj:
 	class_destroy(dev_class);
 r_class:
-	unregister_chrdev_region(dev,1);
-	cdev_del(&k_cdev);
+	unregister_chrdev_region(dev,SIMTEMP_MAX_DEVICES);
 	return -1;
 }
 
 static void __exit nxp_simtemp_exit(void)
 {
-	struct simtemp_sample val;
-	int ret = 0;
-	int i = 1;
-	unsigned long flags;
-	
-	//Cancel the timer if it's active
-	ret = hrtimer_cancel(&my_timer);
-	if(ret)
-		pr_info("nxp_simtemp: Timer was still active and canceled\n");
+	unsigned int i;
 	
-	//Drain and free FIFO
-	spin_lock_irqsave(&fifo_lock,flags);
-	while(!kfifo_is_empty(&CBuffer))
+	for(i = 0; i < SIMTEMP_MAX_DEVICES; i++)
 	{
-		if (kfifo_out(&CBuffer, &val, 1) != 1)
+		if(fallback_pdevs[i])
 		{
-			pr_warn("nxp_simtemp: Failed to drain FIFO at exit\n");
+			platform_device_unregister(fallback_pdevs[i]);
 		}
-
-		pr_info("nxp_simtemp: %d Drained %d\n",i++,val.temp_mC);
 	}
-	spin_unlock_irqrestore(&fifo_lock,flags);
+	//Removes the DT instances
+	platform_driver_unregister(&nxp_simtemp_driver);
 	
-	sysfs_remove_group(kobj_ref,&attr_group);
+	debugfs_remove_recursive(debugfs_root);
 	kobject_put(kobj_ref);
-	device_destroy(dev_class,dev);
 	class_destroy(dev_class);
-	cdev_del(&k_cdev);
-	unregister_chrdev_region(dev,1);
-	platform_driver_unregister(&nxp_simtemp_driver);
+	unregister_chrdev_region(dev,SIMTEMP_MAX_DEVICES);
 	pr_info("nxp_simtemp: Device Driver Remove Done\n");
 }
 
@@ -2,6 +2,7 @@
 #define _SIMTEMP_H_
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 #define E_NO_ERR		10
 #define E_EV_S_US		11
@@ -15,6 +16,17 @@
 #define E_KO_CREATE		19
 #define E_SYS_CREATE	20
 #define E_OR_TH			21
+#define E_EV_FS			22
+#define E_OR_FS			23
+#define E_EV_TK			24
+#define E_OR_TK			25
+#define E_EV_PL			26
+#define E_EV_CX			27
+#define E_EV_HY			28
+#define E_OR_HY			29
+#define E_EV_WV			30
+#define E_OR_WV			31
+#define E_EV_SD			32
 
 const char * sim_errors[] = { "NO_ERROR",
 	"EINVAL_sampling_us",
@@ -28,6 +40,17 @@ const char * sim_errors[] = { "NO_ERROR",
 	"CREATE_kobject",
 	"CREATE sysfs group",
 	"OUTOFRANGE_threshold_mC",
+	"EINVAL_fifo_size",
+	"OUTOFRANGE_fifo_size",
+	"EINVAL_tick_us",
+	"OUTOFRANGE_tick_us",
+	"EINVAL_phase_lock",
+	"EINVAL_context",
+	"EINVAL_hysteresis_mC",
+	"OUTOFRANGE_hysteresis_mC",
+	"EINVAL_wave",
+	"OUTOFRANGE_wave_mC",
+	"EINVAL_seed",
 };
 	
 	
@@ -40,11 +63,139 @@ struct simtemp_sample {
 	__u32 flags;		//
 }__attribute__((packed));
 
+//Record of SIMTEMP_FMT_V2, naturally aligned
+struct simtemp_sample_v2 {
+	__u64 seq;			//position since insmod, a gap counts the samples lost
+	__u64 timestamp_ns;	//monotonic timestamp
+	__s32 temp_mC;		//milli-degree Celsius
+	__u32 flags;		//
+};
+
+//Record formats returned by read(), selected per file, the mmap ring is always V1
+#define SIMTEMP_FMT_V1	1	//struct simtemp_sample, default
+#define SIMTEMP_FMT_V2	2	//struct simtemp_sample_v2
+#define SIMTEMP_FMT_AGG	3	//struct simtemp_agg, one record per closed window
+#define SIMTEMP_FMT_DELTA	4	//struct simtemp_frame headers followed by delta encoded samples
+
+//Header of a SIMTEMP_FMT_DELTA frame, the first sample is stored in full
+struct simtemp_frame {
+	__u64 seq;			//position of the first sample, a gap to the previous seq + count counts the samples lost
+	__u64 base_ns;		//timestamp of the first sample
+	__u32 period_us;		//nominal spacing of the samples
+	__s32 base_mC;		//temperature of the first sample
+	__u32 flags;		//flags of the first sample
+	__u32 count;		//samples in the frame
+	__u32 size;			//payload bytes after the header, the next frame starts at the next multiple of 8
+	__u32 reserved;
+};
+//Payload, for every sample after the first, LEB128 varints:
+//	zigzag(timestamp_ns - previous timestamp_ns - period_us * 1000) << 1 | flags changed
+//	flags, only if they changed
+//	zigzag(temp_mC - previous temp_mC)
+
+//Summary of a window of SIMTEMP_FMT_AGG, mean = sum_mC / count
+struct simtemp_agg {
+	__u64 seq;			//position of the first sample, a gap to the previous seq + count counts the samples lost
+	__u64 start_ns;		//timestamp of the first sample
+	__u64 end_ns;		//timestamp of the last sample
+	__u32 count;		//samples in the window
+	__u32 alerts;		//samples with FLAG_THRESHOLD_CROSSED
+	__s32 min_mC;
+	__s32 max_mC;
+	__s64 sum_mC;
+	__u64 sum_sq;		//sum of temp_mC squared, variance = sum_sq / count - mean^2
+};
+
+//Alert edges, queued per file and signalled with POLLPRI
+#define SIMTEMP_EVENT_ASSERT	1	//temp_mC went above threshold_mC
+#define SIMTEMP_EVENT_CLEAR		2	//temp_mC went down to threshold_mC - hysteresis_mC
+
+struct simtemp_event {
+	__u64 seq;			//position of the sample that crossed
+	__u64 timestamp_ns;	//timestamp of that sample
+	__s32 temp_mC;
+	__s32 threshold_mC;	//threshold crossed, the assert or the clear one
+	__u32 type;			//SIMTEMP_EVENT_*
+	__u32 lost;			//edges dropped before this one because the queue was full
+};
+
+//Window of SIMTEMP_FMT_AGG, closed by whichever bound comes first, 0 disables a bound
+struct simtemp_window {
+	__u32 samples;		//close after this many samples
+	__u32 time_us;		//close at multiples of this period of the sample timestamps
+};
+
+//Waveform played by the replay mode, uploaded with one write(): this header followed by count __s32 temperatures in mC
+#define SIMTEMP_WAVE_LOOP	(1 << 0)	//restart from the first value, otherwise the last one is held
+#define SIMTEMP_WAVE_MAX	(1 << 20)	//values per waveform
+
+struct simtemp_wave {
+	__u32 count;		//values that follow, 1 to SIMTEMP_WAVE_MAX
+	__u32 flags;		//SIMTEMP_WAVE_*
+};
+
+//mmap ring: one control page followed by SIMTEMP_RING_PAGES data pages
+#define SIMTEMP_RING_PAGES	16
+
+struct simtemp_ring_ctrl {
+	__u64 data_head;	//next index written by the driver
+	__u64 data_tail;	//next index read by the consumer
+	__u64 lost;			//samples dropped because the ring was full
+	__u32 data_offset;	//offset of the sample array from the mapping start
+	__u32 data_size;	//number of samples in the ring, power of two
+};
+
+//ioctl commands on /dev/simtempN
+#define SIMTEMP_IOC_MAGIC		's'
+#define SIMTEMP_IOC_GET_OVERRUN	_IOR(SIMTEMP_IOC_MAGIC, 1, __u64)	//samples this file lost
+#define SIMTEMP_IOC_SET_WAKE	_IOW(SIMTEMP_IOC_MAGIC, 2, struct simtemp_wake)
+#define SIMTEMP_IOC_GET_WAKE	_IOR(SIMTEMP_IOC_MAGIC, 3, struct simtemp_wake)
+#define SIMTEMP_IOC_SET_FORMAT	_IOW(SIMTEMP_IOC_MAGIC, 4, __u32)	//SIMTEMP_FMT_*
+#define SIMTEMP_IOC_GET_FORMAT	_IOR(SIMTEMP_IOC_MAGIC, 5, __u32)
+#define SIMTEMP_IOC_SET_LOWAT	_IOW(SIMTEMP_IOC_MAGIC, 6, __u32)	//poll readiness threshold in samples, sets simtemp_wake.samples
+#define SIMTEMP_IOC_GET_LOWAT	_IOR(SIMTEMP_IOC_MAGIC, 7, __u32)
+#define SIMTEMP_IOC_GET_CONFIG	_IOR(SIMTEMP_IOC_MAGIC, 8, struct simtemp_status)
+#define SIMTEMP_IOC_SET_CONFIG	_IOWR(SIMTEMP_IOC_MAGIC, 9, struct simtemp_status)	//returns the applied config and stats
+#define SIMTEMP_IOC_SET_WINDOW	_IOW(SIMTEMP_IOC_MAGIC, 10, struct simtemp_window)	//restarts the open window
+#define SIMTEMP_IOC_GET_WINDOW	_IOR(SIMTEMP_IOC_MAGIC, 11, struct simtemp_window)
+#define SIMTEMP_IOC_GET_EVENT	_IOR(SIMTEMP_IOC_MAGIC, 12, struct simtemp_event)	//oldest queued alert edge, -EAGAIN when none
+
+//Per file wakeup coalescing, samples with FLAG_THRESHOLD_CROSSED always wake
+struct simtemp_wake {
+	__u32 samples;		//wake once this many samples are queued, 1 wakes on every sample
+	__u32 latency_us;	//wake anyway once the oldest unread sample is this old, 0 disables it
+	__u32 adaptive;		//tune samples from the observed drain rate
+};
+
 struct simtemp_flags {
 	__u64 counter;		//number of samples since insmod
 	__u64 alert;		//number of alerts since insmod
+	__u64 overrun;		//samples lost by readers and the mmap ring since insmod
 	__u8 l_error;		//last error
 }__attribute__((packed));
 
+//Temperature generation modes, value of simtemp_config.mode and of the mode sysfs file
+#define MODE_NRM 0
+#define MODE_NSY 1
+#define MODE_RMP 2
+#define MODE_RPL 3
+
+//Whole configuration of an instance, SIMTEMP_IOC_SET_CONFIG applies it at once
+struct simtemp_config {
+	__u32 sampling_us;
+	__s32 threshold_mC;
+	__u32 mode;			//MODE_NRM, MODE_NSY, MODE_RMP or MODE_RPL
+	__u32 tick_us;
+	__u32 phase_lock;	//0 free running, 1 locked to multiples of the period
+	__u32 context;		//0 hardirq, 1 softirq, 2 thread
+	__u32 hysteresis_mC;	//an alert clears at threshold_mC - hysteresis_mC
+	__u32 fifo_size;	//read only, resized through sysfs
+};
+
+struct simtemp_status {
+	struct simtemp_config config;
+	struct simtemp_flags stats;
+};
+
 
 #endif
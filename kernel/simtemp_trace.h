@@ -0,0 +1,122 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simtemp
+
+#if !defined(_SIMTEMP_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _SIMTEMP_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+//One sample generated by the timer
+TRACE_EVENT(simtemp_sample,
+	TP_PROTO(int id, u8 mode, s32 temp_mC, u32 flags),
+	TP_ARGS(id, mode, temp_mC, flags),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u8, mode)
+		__field(s32, temp_mC)
+		__field(u32, flags)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->mode = mode;
+		__entry->temp_mC = temp_mC;
+		__entry->flags = flags;
+	),
+	TP_printk("dev=%d mode=%u temp_mC=%d flags=0x%x",
+		__entry->id, __entry->mode, __entry->temp_mC, __entry->flags)
+);
+
+//A batch published to the history ring, used is the history ring occupancy
+TRACE_EVENT(simtemp_enqueue,
+	TP_PROTO(int id, u64 head, u32 n, u32 used, u32 size, u32 ring_used),
+	TP_ARGS(id, head, n, used, size, ring_used),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(u64, head)
+		__field(u32, n)
+		__field(u32, used)
+		__field(u32, size)
+		__field(u32, ring_used)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->head = head;
+		__entry->n = n;
+		__entry->used = used;
+		__entry->size = size;
+		__entry->ring_used = ring_used;
+	),
+	TP_printk("dev=%d head=%llu n=%u used=%u/%u ring_used=%u",
+		__entry->id, __entry->head, __entry->n, __entry->used, __entry->size, __entry->ring_used)
+);
+
+//Samples lost before a reader got them, reader is NULL for the mmap ring
+TRACE_EVENT(simtemp_drop,
+	TP_PROTO(int id, const void *reader, u64 pos, u64 n),
+	TP_ARGS(id, reader, pos, n),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(const void *, reader)
+		__field(u64, pos)
+		__field(u64, n)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->reader = reader;
+		__entry->pos = pos;
+		__entry->n = n;
+	),
+	TP_printk("dev=%d reader=%p pos=%llu n=%llu",
+		__entry->id, __entry->reader, __entry->pos, __entry->n)
+);
+
+//A reader woken by the timer
+TRACE_EVENT(simtemp_wake,
+	TP_PROTO(int id, const void *reader, u64 pending, bool alert),
+	TP_ARGS(id, reader, pending, alert),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(const void *, reader)
+		__field(u64, pending)
+		__field(bool, alert)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->reader = reader;
+		__entry->pending = pending;
+		__entry->alert = alert;
+	),
+	TP_printk("dev=%d reader=%p pending=%llu alert=%d",
+		__entry->id, __entry->reader, __entry->pending, __entry->alert)
+);
+
+//read() returning, age_ns is how old the newest returned sample is
+TRACE_EVENT(simtemp_read,
+	TP_PROTO(int id, const void *reader, size_t count, u64 overrun, u64 age_ns),
+	TP_ARGS(id, reader, count, overrun, age_ns),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(const void *, reader)
+		__field(size_t, count)
+		__field(u64, overrun)
+		__field(u64, age_ns)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->reader = reader;
+		__entry->count = count;
+		__entry->overrun = overrun;
+		__entry->age_ns = age_ns;
+	),
+	TP_printk("dev=%d reader=%p count=%zu overrun=%llu age_ns=%llu",
+		__entry->id, __entry->reader, __entry->count, __entry->overrun, __entry->age_ns)
+);
+
+#endif
+
+//The header lives next to the driver, not in include/trace/events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE simtemp_trace
+#include <trace/define_trace.h>
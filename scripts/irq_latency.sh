@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# System wakeup latency measured by cyclictest with simtemp generating in each context
+set -e  # Exit on any error
+set -u  # Exit on undefined variables
+
+# Configuration
+device=0
+duration_s=30
+sampling_us=20
+SYSFS=""
+
+# Logging functions
+log_info() {
+    echo "[INFO] $1" >&2
+}
+
+log_error() {
+    echo "[ERROR] $1" >&2
+}
+
+usage() {
+    echo "Usage: $0 [-d device] [-t seconds] [-s sampling_us]"
+    echo "  -d device       simtemp instance to load (default $device)"
+    echo "  -t seconds      cyclictest duration per context (default $duration_s)"
+    echo "  -s sampling_us  Sampling interval while measuring (default $sampling_us)"
+}
+
+# Aggregate the per thread summary lines of cyclictest -q:
+#   T: 0 ( 1234) P:95 I:200 C:  5000 Min:      2 Act:    3 Avg:    3 Max:      15
+summary() {
+    awk -v label="$1" '
+    / Min: / {
+        for (i = 1; i <= NF; i++) {
+            if ($i == "Min:" && (!n || $(i + 1) < min)) min = $(i + 1)
+            if ($i == "Avg:") sum += $(i + 1)
+            if ($i == "Max:" && $(i + 1) > max) max = $(i + 1)
+        }
+        n++
+    }
+    END {
+        if (n) printf "%-10s %8d %8.1f %8d\n", label, min, sum / n, max
+    }'
+}
+
+measure() {
+    cyclictest -m -S -p 95 -i 200 -D "$duration_s" -q | summary "$1"
+}
+
+restore() {
+    echo "$old_sampling_us" > "$SYSFS/sampling_us"
+    echo "$old_context" > "$SYSFS/context"
+}
+
+main() {
+    while getopts "d:t:s:h" opt; do
+        case $opt in
+            d) device=$OPTARG ;;
+            t) duration_s=$OPTARG ;;
+            s) sampling_us=$OPTARG ;;
+            *) usage; return 1 ;;
+        esac
+    done
+
+    SYSFS="/sys/kernel/simtemp/simtemp$device"
+    if [ ! -f "$SYSFS/context" ]; then
+        log_error "$SYSFS/context not found, is the module loaded?"
+        return 1
+    fi
+    if ! command -v cyclictest > /dev/null; then
+        log_error "cyclictest not found, install rt-tests"
+        return 1
+    fi
+
+    old_sampling_us=$(cat "$SYSFS/sampling_us")
+    case $(cat "$SYSFS/context") in
+        softirq) old_context=1 ;;
+        thread) old_context=2 ;;
+        *) old_context=0 ;;
+    esac
+    trap restore EXIT
+
+    printf "%-10s %8s %8s %8s\n" "context" "min_us" "avg_us" "max_us"
+
+    # A new rate applies at the next expiry, a context change restarts the timer at once
+    echo "$sampling_us" > "$SYSFS/sampling_us"
+    for context in 0 1 2; do
+        echo "$context" > "$SYSFS/context"
+        log_info "Measuring $(cat "$SYSFS/context") for $duration_s s"
+        measure "$(cat "$SYSFS/context")"
+    done
+
+    # Baseline, one expiry every 10 s
+    echo 10000000 > "$SYSFS/sampling_us"
+    echo 0 > "$SYSFS/context"
+    log_info "Measuring idle for $duration_s s"
+    measure "idle"
+}
+
+main "$@"
@@ -0,0 +1,130 @@
+#!/bin/bash
+
+# Per-stage latency of the simtemp pipeline from its tracepoints
+set -e  # Exit on any error
+set -u  # Exit on undefined variables
+
+# Configuration
+TRACEFS="/sys/kernel/tracing"
+duration_s=10
+trace_file=""
+
+# Logging functions
+log_info() {
+    echo "[INFO] $1" >&2
+}
+
+log_error() {
+    echo "[ERROR] $1" >&2
+}
+
+usage() {
+    echo "Usage: $0 [-t seconds] [-f trace_file]"
+    echo "  -t seconds     Record the simtemp events for this long (default $duration_s)"
+    echo "  -f trace_file  Analyze an existing trace instead of recording one"
+}
+
+record() {
+    if [ ! -d "$TRACEFS/events/simtemp" ]; then
+        TRACEFS="/sys/kernel/debug/tracing"
+    fi
+    if [ ! -d "$TRACEFS/events/simtemp" ]; then
+        log_error "simtemp events not found, is the module loaded and tracefs mounted?"
+        return 1
+    fi
+
+    log_info "Recording simtemp events for $duration_s s"
+    echo 0 > "$TRACEFS/tracing_on"
+    echo > "$TRACEFS/trace"
+    echo 1 > "$TRACEFS/events/simtemp/enable"
+    echo 1 > "$TRACEFS/tracing_on"
+    sleep "$duration_s"
+    echo 0 > "$TRACEFS/tracing_on"
+    echo 0 > "$TRACEFS/events/simtemp/enable"
+    cat "$TRACEFS/trace"
+}
+
+# Stages, all in microseconds:
+#   generate  first sample of a batch -> batch enqueued
+#   wake      batch enqueued -> reader woken
+#   read      reader woken -> read() returned
+#   age       newest sample timestamp -> read() returned, as reported by the driver
+analyze() {
+    awk '
+    function field(name,    i, kv) {
+        for (i = 1; i <= NF; i++) {
+            if (index($i, name "=") == 1) {
+                split($i, kv, "=")
+                return kv[2]
+            }
+        }
+        return ""
+    }
+    function add(stage, us) {
+        if (!(stage in cnt) || us < min[stage]) min[stage] = us
+        if (!(stage in cnt) || us > max[stage]) max[stage] = us
+        cnt[stage]++
+        sum[stage] += us
+    }
+    / simtemp_[a-z]+: / {
+        for (i = 1; i <= NF; i++) {
+            if ($i ~ /^simtemp_[a-z]+:$/) {
+                event = substr($i, 1, length($i) - 1)
+                ts = $(i - 1)
+                sub(/:$/, "", ts)
+                break
+            }
+        }
+        dev = field("dev")
+        reader = field("reader")
+        if (event == "simtemp_sample") {
+            if (!(dev in batch_start)) batch_start[dev] = ts
+        } else if (event == "simtemp_enqueue") {
+            if (dev in batch_start) {
+                add("generate", (ts - batch_start[dev]) * 1e6)
+                delete batch_start[dev]
+            }
+            enqueued[dev] = ts
+        } else if (event == "simtemp_wake") {
+            if (dev in enqueued) add("wake", (ts - enqueued[dev]) * 1e6)
+            woken[reader] = ts
+        } else if (event == "simtemp_read") {
+            if (reader in woken) {
+                add("read", (ts - woken[reader]) * 1e6)
+                delete woken[reader]
+            }
+            if (field("count") > 0) add("age", field("age_ns") / 1e3)
+        } else if (event == "simtemp_drop") {
+            dropped += field("n")
+        }
+    }
+    END {
+        printf "%-10s %10s %12s %12s %12s\n", "stage", "count", "min_us", "avg_us", "max_us"
+        n_stages = split("generate wake read age", order, " ")
+        for (s = 1; s <= n_stages; s++) {
+            stage = order[s]
+            if (!(stage in cnt)) continue
+            printf "%-10s %10d %12.1f %12.1f %12.1f\n", stage, cnt[stage], min[stage], sum[stage] / cnt[stage], max[stage]
+        }
+        printf "dropped samples: %d\n", dropped
+    }'
+}
+
+main() {
+    while getopts "t:f:h" opt; do
+        case $opt in
+            t) duration_s=$OPTARG ;;
+            f) trace_file=$OPTARG ;;
+            *) usage; return 1 ;;
+        esac
+    done
+
+    if [ -n "$trace_file" ]; then
+        log_info "Analyzing $trace_file"
+        analyze < "$trace_file"
+    else
+        record | analyze
+    fi
+}
+
+main "$@"
@@ -0,0 +1,138 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+//Generators of kernel/gaussian_random.c, built against the shim headers
+extern "C" {
+int32_t gaussian_s32_clt(int32_t mean, int32_t stddev);
+int32_t gaussian_s32_icdf(int32_t mean, int32_t stddev);
+}
+
+//Histogram of z scores, 0.5 sigma bins in [-4, 4] plus two tail bins
+#define HIST_BINS 18
+#define HIST_BIN_Z 0.5
+
+struct Result {
+	double ns_per_sample;
+	double mean;
+	double stddev;
+	double skewness;
+	double kurtosis;	//excess kurtosis
+	double chi2;		//shape, against a normal with the measured mean and stddev
+	double max_z;
+};
+
+//Standard normal CDF
+static double normalCdf(double z)
+{
+	return 0.5 * std::erfc(-z / std::sqrt(2.0));
+}
+
+static Result run(int32_t (*gen)(int32_t, int32_t), int32_t mean, int32_t stddev, uint64_t n_samples)
+{
+	Result res;
+	double sum = 0, sum2 = 0, sum3 = 0, sum4 = 0;
+	int64_t checksum = 0;
+	
+	//Timed pass, the checksum keeps the calls from being optimized out
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t i = 0; i < n_samples; i++)
+	{
+		checksum += gen(mean, stddev);
+	}
+	auto end = std::chrono::steady_clock::now();
+	res.ns_per_sample = std::chrono::duration<double, std::nano>(end - start).count() / n_samples;
+	if(checksum == 0)
+	{
+		std::cerr << "checksum 0" << std::endl;
+	}
+	
+	//Moments pass
+	int32_t *values = new int32_t[n_samples];
+	for(uint64_t i = 0; i < n_samples; i++)
+	{
+		values[i] = gen(mean, stddev);
+		sum += values[i];
+	}
+	res.mean = sum / n_samples;
+	for(uint64_t i = 0; i < n_samples; i++)
+	{
+		double d = values[i] - res.mean;
+		sum2 += d * d;
+		sum3 += d * d * d;
+		sum4 += d * d * d * d;
+	}
+	res.stddev = std::sqrt(sum2 / n_samples);
+	res.skewness = (sum3 / n_samples) / std::pow(res.stddev, 3);
+	res.kurtosis = (sum4 / n_samples) / std::pow(res.stddev, 4) - 3.0;
+	
+	//Shape pass
+	uint64_t hist[HIST_BINS] = {0};
+	res.max_z = 0;
+	for(uint64_t i = 0; i < n_samples; i++)
+	{
+		double z = (values[i] - res.mean) / res.stddev;
+		int bin = (int)std::floor(z / HIST_BIN_Z) + HIST_BINS / 2;
+		bin = std::min(std::max(bin, 0), HIST_BINS - 1);
+		hist[bin]++;
+		res.max_z = std::max(res.max_z, std::fabs(z));
+	}
+	res.chi2 = 0;
+	for(int bin = 0; bin < HIST_BINS; bin++)
+	{
+		double lo = (bin == 0) ? -INFINITY : (bin - HIST_BINS / 2) * HIST_BIN_Z;
+		double hi = (bin == HIST_BINS - 1) ? INFINITY : (bin - HIST_BINS / 2 + 1) * HIST_BIN_Z;
+		double expected = (normalCdf(hi) - normalCdf(lo)) * n_samples;
+		res.chi2 += (hist[bin] - expected) * (hist[bin] - expected) / expected;
+	}
+	
+	delete[] values;
+	return res;
+}
+
+static void print(const char *name, const Result &res, int32_t mean, int32_t stddev)
+{
+	std::cout << std::left << std::setw(6) << name << std::right << std::fixed
+		<< std::setprecision(2) << std::setw(9) << res.ns_per_sample
+		<< std::setprecision(1) << std::setw(11) << res.mean
+		<< std::setw(10) << res.stddev
+		<< std::setprecision(4) << std::setw(9) << res.stddev / stddev
+		<< std::setw(10) << (res.mean - mean) / stddev
+		<< std::setw(9) << res.skewness
+		<< std::setw(9) << res.kurtosis
+		<< std::setprecision(1) << std::setw(10) << res.chi2
+		<< std::setprecision(2) << std::setw(7) << res.max_z << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t n_samples = (argc > 1) ? std::strtoull(argv[1], NULL, 0) : 10000000;
+	int32_t stddev = (argc > 2) ? std::atoi(argv[2]) : 2000;
+	int32_t mean = 20000;
+	
+	if(n_samples == 0 || stddev <= 0)
+	{
+		std::cerr << "Usage: gaussian_bench [samples] [stddev_mC]" << std::endl;
+		return 2;
+	}
+	
+	Result clt = run(gaussian_s32_clt, mean, stddev, n_samples);
+	Result icdf = run(gaussian_s32_icdf, mean, stddev, n_samples);
+	
+	std::cout << n_samples << " samples, mean " << mean << " mC, stddev " << stddev << " mC" << std::endl;
+	std::cout << "gen    ns/smpl       mean    stddev  sd/want  mean_err     skew  ex_kurt  chi2(17)  max_z" << std::endl;
+	print("clt", clt, mean, stddev);
+	print("icdf", icdf, mean, stddev);
+	
+	//The inverse CDF generator must honour the requested moments and look normal
+	bool pass = std::fabs(icdf.stddev / stddev - 1.0) < 0.01 &&
+		std::fabs(icdf.mean - mean) / stddev < 0.01 &&
+		std::fabs(icdf.skewness) < 0.01 &&
+		std::fabs(icdf.kurtosis) < 0.05;
+	std::cout << "icdf " << (pass ? "PASS" : "FAIL") << ", speedup " << std::setprecision(1) << clt.ns_per_sample / icdf.ns_per_sample << "x" << std::endl;
+	
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <cstdio>
+
+//Half table of the normal quantile function used by gaussian_s32_icdf()
+#define ICDF_BITS 10
+#define ICDF_SIZE (1 << ICDF_BITS)
+
+//The last bin of the half table is split again, so the tail is not cut at 3.3 sigma
+#define TAIL_BITS 6
+#define TAIL_SIZE (1 << TAIL_BITS)
+
+//Upper tail probability of the standard normal
+static double normalQ(double x)
+{
+	return 0.5 * std::erfc(x / std::sqrt(2.0));
+}
+
+//Function that inverts normalQ() by bisection, exact to double precision
+static double normalQuantile(double p)
+{
+	double lo = 0.0, hi = 40.0;
+	
+	for(int i = 0; i < 200; i++)
+	{
+		double mid = 0.5 * (lo + hi);
+		if(0.5 + (0.5 - normalQ(mid)) < p)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return 0.5 * (lo + hi);
+}
+
+//Standard normal density
+static double normalPdf(double x)
+{
+	return std::exp(-0.5 * x * x) / std::sqrt(2.0 * M_PI);
+}
+
+static void printTable(const char *name, const char *size, const double *q, int n)
+{
+	std::printf("static const u32 %s[%s] = {", name, size);
+	for(int i = 0; i < n; i++)
+	{
+		std::printf("%s%ld,", (i % 8) ? " " : "\n\t", std::lround(q[i] * 65536.0));
+	}
+	std::printf("\n};\n\n");
+}
+
+int main()
+{
+	double q[ICDF_SIZE];
+	double tail[TAIL_SIZE + 1];
+	double p_tail = 0.5 / ICDF_SIZE;	//probability of the last bin
+	
+	for(int i = 0; i < ICDF_SIZE; i++)
+	{
+		q[i] = normalQuantile(0.5 + 0.5 * i / ICDF_SIZE);
+	}
+	for(int i = 0; i < TAIL_SIZE; i++)
+	{
+		tail[i] = normalQuantile(1.0 - p_tail + p_tail * i / TAIL_SIZE);
+	}
+	//The last tail bin is unbounded, its end point keeps the mean of the tail
+	double p_bin = p_tail / TAIL_SIZE;
+	double tail_mean = normalPdf(tail[TAIL_SIZE - 1]) / p_bin;
+	tail[TAIL_SIZE] = 2.0 * tail_mean - tail[TAIL_SIZE - 1];
+	
+	std::printf("#ifndef _GAUSSIAN_TABLE_H_\n#define _GAUSSIAN_TABLE_H_\n\n");
+	std::printf("//Generated by user/bench/gen_gaussian_table, do not edit\n\n");
+	std::printf("#define GAUSSIAN_ICDF_BITS %d\n", ICDF_BITS);
+	std::printf("#define GAUSSIAN_TAIL_BITS %d\n\n", TAIL_BITS);
+	std::printf("//Normal quantile in Q16 at p = 0.5 + 0.5 * i / %d\n", ICDF_SIZE);
+	printTable("gaussian_icdf_q16", "1 << GAUSSIAN_ICDF_BITS", q, ICDF_SIZE);
+	std::printf("//Normal quantile in Q16 over the last bin, last entry extrapolated to keep the tail mean\n");
+	printTable("gaussian_tail_q16", "(1 << GAUSSIAN_TAIL_BITS) + 1", tail, TAIL_SIZE + 1);
+	std::printf("#endif\n");
+	
+	return 0;
+}
@@ -0,0 +1,4 @@
+#ifndef _SHIM_LINUX_INIT_H_
+#define _SHIM_LINUX_INIT_H_
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _SHIM_LINUX_KERNEL_H_
+#define _SHIM_LINUX_KERNEL_H_
+
+#include <limits.h>
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef _SHIM_LINUX_MATH64_H_
+#define _SHIM_LINUX_MATH64_H_
+
+#endif
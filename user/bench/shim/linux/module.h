@@ -0,0 +1,9 @@
+#ifndef _SHIM_LINUX_MODULE_H_
+#define _SHIM_LINUX_MODULE_H_
+
+#define EXPORT_SYMBOL(sym)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+
+#endif
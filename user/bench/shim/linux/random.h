@@ -0,0 +1,27 @@
+#ifndef _SHIM_LINUX_RANDOM_H_
+#define _SHIM_LINUX_RANDOM_H_
+
+#include <linux/types.h>
+
+//Same Tausworthe generator (LFSR113) as the kernel prandom_u32()
+struct rnd_state {
+	u32 s1, s2, s3, s4;
+};
+
+static struct rnd_state prandom_state = { 0x12345678U, 0x9abcdef0U, 0x0fedcba9U, 0x87654321U };
+
+#define TAUSWORTHE(s, a, b, c, d) ((s & c) << d) ^ (((s << a) ^ s) >> b)
+
+static inline u32 prandom_u32(void)
+{
+	struct rnd_state *state = &prandom_state;
+	
+	state->s1 = TAUSWORTHE(state->s1,  6U, 13U, 4294967294U, 18U);
+	state->s2 = TAUSWORTHE(state->s2,  2U, 27U, 4294967288U,  2U);
+	state->s3 = TAUSWORTHE(state->s3, 13U, 21U, 4294967280U,  7U);
+	state->s4 = TAUSWORTHE(state->s4,  3U, 12U, 4294967168U, 13U);
+	
+	return state->s1 ^ state->s2 ^ state->s3 ^ state->s4;
+}
+
+#endif
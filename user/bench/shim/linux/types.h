@@ -0,0 +1,15 @@
+#ifndef _SHIM_LINUX_TYPES_H_
+#define _SHIM_LINUX_TYPES_H_
+
+//Kernel types for building kernel/gaussian_random.c in userspace
+#include <stdint.h>
+
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef uint32_t __u32;
+typedef int32_t __s32;
+typedef uint64_t __u64;
+
+#endif
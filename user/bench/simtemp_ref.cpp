@@ -0,0 +1,170 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "lib.h"
+
+//Generator of kernel/gaussian_random.c, built against the shim headers
+extern "C" {
+#include "gaussian_random.h"
+}
+
+//Same mean and standard deviations as the driver modes
+#define TEMP_MEAN_mC 20000
+#define STD_NRM_mC 100
+#define STD_NSY_mC 2000
+
+//Consecutive values that must match to locate the first sample of the seed in the device stream
+#define ALIGN_SAMPLES 8
+#define ALIGN_LIMIT 10000000 // samples searched, the seed write is long done by then
+
+//Reference stream: temperature k is the k-th normal or noisy sample generated after the seed was written
+static std::vector<int32_t> reference(uint64_t seed, int32_t stddev, size_t n_samples)
+{
+	struct gaussian_rng rng;
+	std::vector<int32_t> temps(n_samples);
+
+	gaussian_rng_seed(&rng, seed);
+	for(size_t i = 0; i < n_samples; i++)
+	{
+		temps[i] = gaussian_s32_icdf_rng(&rng, TEMP_MEAN_mC, stddev);
+	}
+	return temps;
+}
+
+static int writeSysfs(unsigned int index, const char *file, const std::string &value)
+{
+	std::string path = "/sys/kernel/simtemp/simtemp" + std::to_string(index) + "/" + file;
+	int fd = open(path.c_str(), O_WRONLY);
+
+	if(fd < 0 || write(fd, value.c_str(), value.size()) < 0)
+	{
+		perror(path.c_str());
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+//Seed /dev/simtempN and compare its stream with the reference, returns the number of mismatches or -1
+static long compareDevice(unsigned int index, uint64_t seed, char mode, const std::vector<int32_t> &temps)
+{
+	std::string path = "/dev/simtemp" + std::to_string(index);
+	uint32_t format = SIMTEMP_FMT_V2;
+	struct simtemp_sample_v2 batch[64];
+	std::vector<struct simtemp_sample_v2> stream;
+	size_t start = 0;
+	bool aligned = false;
+	long mismatches = 0;
+
+	//Opened first, so the file sees every sample from before the seed write on
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		perror(path.c_str());
+		return -1;
+	}
+	if(ioctl(fd, SIMTEMP_IOC_SET_FORMAT, &format) != 0 ||
+		writeSysfs(index, "mode", mode == 'n' ? "1" : "0") != 0 ||
+		writeSysfs(index, "seed", std::to_string(seed)) != 0)
+	{
+		perror("setup");
+		close(fd);
+		return -1;
+	}
+
+	while(!aligned || stream.size() < start + temps.size())
+	{
+		ssize_t bytes_read = read(fd, batch, sizeof(batch));
+		if(bytes_read < 0)
+		{
+			perror("read");
+			close(fd);
+			return -1;
+		}
+		stream.insert(stream.end(), batch, batch + bytes_read / sizeof(batch[0]));
+		
+		//Samples generated before the write belong to the previous seed
+		while(!aligned && start + ALIGN_SAMPLES <= stream.size())
+		{
+			size_t i = 0;
+			while(i < ALIGN_SAMPLES && stream[start + i].temp_mC == temps[i])
+			{
+				i++;
+			}
+			aligned = (i == ALIGN_SAMPLES);
+			start += aligned ? 0 : 1;
+		}
+		if(!aligned && start > ALIGN_LIMIT)
+		{
+			std::cerr << "Seeded sequence not found in the device stream" << std::endl;
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+
+	for(size_t i = 0; i < temps.size(); i++)
+	{
+		const struct simtemp_sample_v2 &sample = stream[start + i];
+		if(sample.seq != stream[start].seq + i)
+		{
+			std::cerr << "Samples lost at seq " << sample.seq << ", sample slower" << std::endl;
+			return -1;
+		}
+		if(sample.temp_mC != temps[i])
+		{
+			if(mismatches == 0)
+			{
+				std::cerr << "First mismatch at sample " << i << ": device " << sample.temp_mC << " reference " << temps[i] << std::endl;
+			}
+			mismatches++;
+		}
+	}
+	std::cout << temps.size() << " samples from seq " << stream[start].seq << ", " << mismatches << " mismatches" << std::endl;
+	return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+	int arg = 1;
+	bool device = false;
+	unsigned int index = 0;
+
+	if(argc > 2 && std::strcmp(argv[1], "-d") == 0)
+	{
+		device = true;
+		index = std::strtoul(argv[2], NULL, 0);
+		arg = 3;
+	}
+	if(argc - arg != 3 || (argv[arg + 1][0] != 'd' && argv[arg + 1][0] != 'n') || std::strtoull(argv[arg + 2], NULL, 0) < ALIGN_SAMPLES)
+	{
+		std::cerr << "Usage: simtemp_ref [-d N] seed mode[d,n] samples(>= " << ALIGN_SAMPLES << ")" << std::endl;
+		std::cerr << "Prints the temperatures the driver generates after the seed is written, -d N compares them with /dev/simtempN" << std::endl;
+		return 2;
+	}
+	uint64_t seed = std::strtoull(argv[arg], NULL, 0);
+	char mode = argv[arg + 1][0];
+	size_t n_samples = std::strtoull(argv[arg + 2], NULL, 0);
+	std::vector<int32_t> temps = reference(seed, mode == 'n' ? STD_NSY_mC : STD_NRM_mC, n_samples);
+
+	if(device)
+	{
+		return compareDevice(index, seed, mode, temps) == 0 ? 0 : 1;
+	}
+	for(int32_t temp : temps)
+	{
+		std::cout << temp << "\n";
+	}
+	return 0;
+}
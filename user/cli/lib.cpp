@@ -1,7 +1,22 @@
 #include "lib.h"
 
 //Temperature modes names
-const char * modes[] ={"default","noisy","ramp"};
+const char * modes[] ={"default","noisy","ramp","replay"};
+
+//Instance used by the CLI, selected with -d
+static unsigned int dev_index = 0;
+
+//Function that returns the character device of the instance
+std::string devicePath()
+{
+	return "/dev/simtemp" + std::to_string(dev_index);
+}
+
+//Function that returns a sysfs file of the instance
+std::string sysfsPath(const char *file)
+{
+	return "/sys/kernel/simtemp/simtemp" + std::to_string(dev_index) + "/" + file;
+}
 
 //Function to obtain the date in the desired format
 void getDate(char * date,uint64_t ns)
@@ -17,8 +32,161 @@ void getDate(char * date,uint64_t ns)
 	sprintf(date,"%s.%03ldZ",buffer,nanoseconds/1000000);
 }
 
-//Function that shows parameters set when the driver is loaded
-int showDefaultSimParameters()
+//Function that prints one sample, the caller flushes once per batch
+void printSample(const struct simtemp_sample &sample)
+{
+	char date[128] = {0};
+	
+	getDate(date,sample.timestamp_ns);
+	std::cout << date << " temp=" << std::fixed << std::setprecision(1) <<(double)sample.temp_mC/1000 << "C alert=" << (sample.flags & FLAG_THRESHOLD_CROSSED ? "1":"0") << "\n";
+}
+
+//Function that prints one V2 record, reporting the samples lost since the previous one
+void printRecord(const struct simtemp_sample_v2 &sample, uint64_t &next_seq)
+{
+	struct simtemp_sample v1 = {sample.timestamp_ns, sample.temp_mC, sample.flags};
+	
+	if(next_seq != 0 && sample.seq > next_seq)
+	{
+		std::cout << "lost=" << sample.seq - next_seq << "\n";
+	}
+	next_seq = sample.seq + 1;
+	printSample(v1);
+}
+
+//Function that prints the summary of one window, reporting the samples lost since the previous one
+void printWindow(const struct simtemp_agg &agg, uint64_t &next_seq)
+{
+	char date[128] = {0};
+	double mean = (double)agg.sum_mC / agg.count;
+	double variance = (double)agg.sum_sq / agg.count - mean * mean;
+	
+	if(next_seq != 0 && agg.seq > next_seq)
+	{
+		std::cout << "lost=" << agg.seq - next_seq << "\n";
+	}
+	next_seq = agg.seq + agg.count;
+	getDate(date,agg.end_ns);
+	std::cout << date << " count=" << agg.count << std::fixed << std::setprecision(3)
+		<< " min=" << (double)agg.min_mC/1000 << "C max=" << (double)agg.max_mC/1000
+		<< "C mean=" << mean/1000 << "C std=" << std::sqrt(variance > 0 ? variance : 0)/1000
+		<< "C alerts=" << agg.alerts << "\n";
+}
+
+//Function that prints one alert edge
+void printEvent(const struct simtemp_event &event)
+{
+	char date[128] = {0};
+	
+	if(event.lost != 0)
+	{
+		std::cout << "lost=" << event.lost << "\n";
+	}
+	getDate(date,event.timestamp_ns);
+	std::cout << date << (event.type == SIMTEMP_EVENT_ASSERT ? " ASSERT" : " CLEAR") << std::fixed << std::setprecision(1)
+		<< " temp=" << (double)event.temp_mC/1000 << "C threshold=" << (double)event.threshold_mC/1000 << "C seq=" << event.seq << "\n";
+}
+
+//Function that reads one LEB128 varint, returns its length or 0 when it runs past end
+static size_t getVarint(const uint8_t *p, const uint8_t *end, uint64_t &value)
+{
+	size_t n = 0;
+	unsigned int shift = 0;
+	
+	value = 0;
+	while(p + n < end && shift < 64)
+	{
+		uint8_t byte = p[n++];
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if(!(byte & 0x80))
+		{
+			return n;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+//Function that undoes the zigzag mapping of signed deltas
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+//Function that decodes the SIMTEMP_FMT_DELTA frames of one read() into V2 records
+//Every sample takes at least 2 bytes, so max_out = len / 2 always suffices. Returns the records decoded or -1 on a malformed frame
+long decodeFrames(const uint8_t *buf, size_t len, struct simtemp_sample_v2 *out, size_t max_out)
+{
+	size_t offset = 0;
+	size_t n_out = 0;
+	
+	while(offset + sizeof(struct simtemp_frame) <= len)
+	{
+		struct simtemp_frame frame;
+		memcpy(&frame,buf + offset,sizeof(frame));
+		const uint8_t *p = buf + offset + sizeof(frame);
+		const uint8_t *end = p + frame.size;
+		if(frame.count == 0 || frame.size > len - offset - sizeof(frame) || n_out + frame.count > max_out)
+		{
+			return -1;
+		}
+		
+		//The first sample is stored in full, the others as deltas to the previous one
+		struct simtemp_sample_v2 sample = {frame.seq, frame.base_ns, frame.base_mC, frame.flags};
+		out[n_out++] = sample;
+		for(uint32_t i = 1; i < frame.count; i++)
+		{
+			uint64_t ts_code, value;
+			size_t n = getVarint(p,end,ts_code);
+			if(n == 0)
+			{
+				return -1;
+			}
+			p += n;
+			if(ts_code & 1)
+			{
+				n = getVarint(p,end,value);
+				if(n == 0)
+				{
+					return -1;
+				}
+				p += n;
+				sample.flags = static_cast<uint32_t>(value);
+			}
+			n = getVarint(p,end,value);
+			if(n == 0)
+			{
+				return -1;
+			}
+			p += n;
+			sample.seq++;
+			sample.timestamp_ns += frame.period_us * 1000ULL + unzigzag(ts_code >> 1);
+			sample.temp_mC += static_cast<int32_t>(unzigzag(value));
+			out[n_out++] = sample;
+		}
+		//Frames start at multiples of 8
+		offset += (sizeof(frame) + frame.size + 7) & ~static_cast<size_t>(7);
+	}
+	return static_cast<long>(n_out);
+}
+
+//Function that reads configuration and stats in one ioctl, errno is ENOTTY on drivers without it
+static int getStatus(struct simtemp_status &status)
+{
+	int fd = open(devicePath().c_str(),O_RDONLY);
+	int ret = 0;
+	
+	if(fd < 0)
+	{
+		return -1;
+	}
+	ret = ioctl(fd,SIMTEMP_IOC_GET_CONFIG,&status);
+	close(fd);
+	return ret;
+}
+
+//Function that shows parameters set when the driver is loaded, through sysfs
+static int showSysfsParameters()
 {
 	double s_s_ms,s_s_us = 0;
 	std::string s_mode;
@@ -28,7 +196,7 @@ int showDefaultSimParameters()
 	ssize_t bytes_read = 0;
 	int fd_s_us, fd_mode, fd_t_mC = 0;
 	
-	fd_s_us = open("/sys/kernel/simtemp/sampling_us",O_RDONLY);
+	fd_s_us = open(sysfsPath("sampling_us").c_str(),O_RDONLY);
 	if(fd_s_us == -1)
 	{
 		perror("open sampling_us");
@@ -45,7 +213,7 @@ int showDefaultSimParameters()
 	s_s_us = (double)(std::stod(buffer));
 	s_s_ms = s_s_us / 1000;
 	
-	fd_mode = open("/sys/kernel/simtemp/mode",O_RDONLY);
+	fd_mode = open(sysfsPath("mode").c_str(),O_RDONLY);
 	if(fd_mode == -1)
 	{
 		perror("open mode");
@@ -61,7 +229,7 @@ int showDefaultSimParameters()
 	buffer[bytes_read]='\0';
 	s_mode = buffer;
 	
-	fd_t_mC = open("/sys/kernel/simtemp/threshold_mC",O_RDONLY);
+	fd_t_mC = open(sysfsPath("threshold_mC").c_str(),O_RDONLY);
 	if(fd_t_mC == -1)
 	{
 		perror("open threshold_mC");
@@ -84,14 +252,38 @@ int showDefaultSimParameters()
 	return 0;	
 }
 
-//Funtion to set simulation parameters
-int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_mC)
+//Function that shows parameters set when the driver is loaded
+int showDefaultSimParameters()
+{
+	struct simtemp_status status;
+	
+	if(getStatus(status) != 0)
+	{
+		if(errno != ENOTTY)
+		{
+			perror("SIMTEMP_IOC_GET_CONFIG");
+			return -1;
+		}
+		return showSysfsParameters();
+	}
+	
+	std::cout << "Sampling rate: " << (double)status.config.sampling_us / 1000 << "ms | " << status.config.sampling_us << "us"<< std::endl;
+	std::cout << "Mode: " << (status.config.mode <= MODE_RPL ? modes[status.config.mode] : "unknown") << std::endl;
+	std::cout << "Temperature threshold: " << status.config.threshold_mC <<" m °C" << std::endl;
+	std::cout << "Hysteresis: " << status.config.hysteresis_mC <<" m °C" << std::endl;
+	std::cout << "Samples: " << status.stats.counter << " | Alerts: " << status.stats.alert << " | Overrun: " << status.stats.overrun << std::endl;
+	
+	return 0;
+}
+
+//Funtion to set simulation parameters through sysfs, one file at a time
+static int setSysfsParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_mC)
 {
 	char buffer[10];
 	ssize_t bytes_written = 0;
 	int fd_s_us, fd_mode, fd_t_mC = 0;
 	
-	fd_s_us = open("/sys/kernel/simtemp/sampling_us",O_WRONLY);
+	fd_s_us = open(sysfsPath("sampling_us").c_str(),O_WRONLY);
 	if(fd_s_us == -1)
 	{
 		perror("open sampling_us");
@@ -109,7 +301,7 @@ int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_m
 		return -1;
 	}
 	
-	fd_mode = open("/sys/kernel/simtemp/mode",O_WRONLY);
+	fd_mode = open(sysfsPath("mode").c_str(),O_WRONLY);
 	if(fd_mode == -1)
 	{
 		perror("open mode");
@@ -126,7 +318,7 @@ int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_m
 		return -1;
 	}
 	
-	fd_t_mC = open("/sys/kernel/simtemp/threshold_mC",O_WRONLY);
+	fd_t_mC = open(sysfsPath("threshold_mC").c_str(),O_WRONLY);
 	if(fd_t_mC == -1)
 	{
 		perror("open threshold_mC");
@@ -147,6 +339,118 @@ int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_m
 	return 0;
 }
 
+//Funtion to set simulation parameters, in one ioctl so the timer never sees part of them
+int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_mC, const int32_t h_mC)
+{
+	struct simtemp_status status;
+	int fd = 0;
+	int ret = 0;
+	
+	if(getStatus(status) != 0)
+	{
+		if(errno != ENOTTY)
+		{
+			perror("SIMTEMP_IOC_GET_CONFIG");
+			return -1;
+		}
+		if(h_mC >= 0)
+		{
+			std::cerr << "This driver has no hysteresis" << std::endl;
+			return -1;
+		}
+		return setSysfsParameters(s_us,mode,t_mC);
+	}
+	
+	//tick_us, phase_lock and context are kept as configured, hysteresis_mC too when h_mC is negative
+	status.config.sampling_us = s_us;
+	status.config.mode = mode;
+	status.config.threshold_mC = static_cast<int32_t>(t_mC);
+	if(h_mC >= 0)
+	{
+		status.config.hysteresis_mC = static_cast<uint32_t>(h_mC);
+	}
+	
+	fd = open(devicePath().c_str(),O_RDONLY);
+	if(fd < 0)
+	{
+		perror("open device");
+		return -1;
+	}
+	ret = ioctl(fd,SIMTEMP_IOC_SET_CONFIG,&status);
+	close(fd);
+	if(ret != 0)
+	{
+		perror("SIMTEMP_IOC_SET_CONFIG");
+		return -1;
+	}
+	return 0;
+}
+
+//Function that uploads a trace file, one temperature in mC per line, as the looped waveform of the replay mode
+int uploadWave(const std::string &path)
+{
+	std::ifstream file(path);
+	std::vector<int32_t> buffer(sizeof(struct simtemp_wave) / sizeof(int32_t));
+	struct simtemp_wave hdr;
+	std::string line;
+	int fd = 0;
+	ssize_t bytes_written = 0;
+	
+	if(!file)
+	{
+		std::cerr << "Cannot open trace file: " << path << std::endl;
+		return -1;
+	}
+	while(std::getline(file,line))
+	{
+		if(line.empty())
+		{
+			continue;
+		}
+		try
+		{
+			long value = std::stol(line);
+			if(value > 100000 || value < -50000)
+			{
+				std::cerr << "Trace value out of range: limits: [-50000, 100000] " << line << std::endl;
+				return -1;
+			}
+			buffer.push_back(static_cast<int32_t>(value));
+		}
+		catch(const std::exception& e)
+		{
+			std::cerr << "Invalid trace value: " << line << std::endl;
+			return -1;
+		}
+	}
+	
+	//The header goes in front of the values, the driver takes the whole table in one write()
+	hdr.count = buffer.size() - sizeof(hdr) / sizeof(int32_t);
+	hdr.flags = SIMTEMP_WAVE_LOOP;
+	if(hdr.count == 0 || hdr.count > SIMTEMP_WAVE_MAX)
+	{
+		std::cerr << "Trace length out of range: limits: [1, " << SIMTEMP_WAVE_MAX << "]" << std::endl;
+		return -1;
+	}
+	memcpy(buffer.data(),&hdr,sizeof(hdr));
+	
+	fd = open(devicePath().c_str(),O_WRONLY);
+	if(fd < 0)
+	{
+		perror("open device");
+		return -1;
+	}
+	bytes_written = write(fd,buffer.data(),buffer.size() * sizeof(int32_t));
+	close(fd);
+	if(bytes_written < 0)
+	{
+		perror("write waveform");
+		return -1;
+	}
+	std::cout << "Waveform uploaded: " << hdr.count << " samples" << std::endl;
+	return 0;
+}
+
 //Function that checks sampling rate is within the limits
 int checkSamplingRate(std::string &st, double &db)
 {
@@ -154,9 +458,9 @@ int checkSamplingRate(std::string &st, double &db)
 	try
 	{
 		db = std::stod(st);
-		if(db > 10000 || db < 0.05)
+		if(db > 10000 || db < 0.001)
 		{
-			std::cerr << "sampling_rate_ms out of range: limits: [0.05, 10000] " << std::endl;
+			std::cerr << "sampling_rate_ms out of range: limits: [0.001, 10000] " << std::endl;
 			ret = -1;
 		}
 	}
@@ -167,7 +471,7 @@ int checkSamplingRate(std::string &st, double &db)
 	}
 	catch(const std::out_of_range& e)
 	{
-		std::cerr << "sampling_rate_ms out of range: limits: [0.05, 10000] " << e.what() << std::endl;
+		std::cerr << "sampling_rate_ms out of range: limits: [0.001, 10000] " << e.what() << std::endl;
 		ret = -1;
 	}
 	return ret;
@@ -192,6 +496,9 @@ int checkMode(std::string &st, uint8_t &md)
 			case 'r':
 				md = MODE_RMP;
 				break;
+			case 'p':
+				md = MODE_RPL;
+				break;
 			default:
 				std::cerr << "Invalid mode: " << st << std::endl;
 				ret = -1;
@@ -231,6 +538,122 @@ int checkThreshold(std::string &st, int32_t &my_int)
 	return ret;
 }
 
+//Function that checks the alert hysteresis is within the limits of the driver
+int checkHysteresis(std::string &st, int32_t &my_int)
+{
+	int ret = 0;
+	try
+	{
+		my_int = static_cast<int32_t>(std::stol(st));
+		if(my_int > 150000 || my_int < 0)
+		{
+			std::cerr << "hysteresis_mC out of range: limits: [0, 150000] " << std::endl;
+			ret = -1;
+		}
+	}
+	catch(const std::invalid_argument& e)
+	{
+		std::cerr << "Invalid hysteresis_mC: "<< e.what() << std::endl;
+		ret = -1;
+	}
+	catch(const std::out_of_range& e)
+	{
+		std::cerr << "hysteresis_mC out of range: limits: [0, 150000] " << e.what() << std::endl;
+		ret = -1;
+	}
+	return ret;
+}
+
+//Function that checks the instance index is within the limits
+int checkDevice(std::string &st, unsigned int &index)
+{
+	int ret = 0;
+	try
+	{
+		long value = std::stol(st);
+		if(value > 63 || value < 0)
+		{
+			std::cerr << "device out of range: limits: [0, 63] " << std::endl;
+			ret = -1;
+		}
+		else
+		{
+			index = static_cast<unsigned int>(value);
+		}
+	}
+	catch(const std::invalid_argument& e)
+	{
+		std::cerr << "Invalid device: "<< e.what() << std::endl;
+		ret = -1;
+	}
+	catch(const std::out_of_range& e)
+	{
+		std::cerr << "device out of range: limits: [0, 63] " << e.what() << std::endl;
+		ret = -1;
+	}
+	return ret;
+}
+
+//Function that checks the window length is within the limits
+int checkWindow(std::string &st, uint32_t &samples)
+{
+	int ret = 0;
+	try
+	{
+		long value = std::stol(st);
+		if(value > 16777216 || value < 1)
+		{
+			std::cerr << "window out of range: limits: [1, 16777216] " << std::endl;
+			ret = -1;
+		}
+		else
+		{
+			samples = static_cast<uint32_t>(value);
+		}
+	}
+	catch(const std::invalid_argument& e)
+	{
+		std::cerr << "Invalid window: "<< e.what() << std::endl;
+		ret = -1;
+	}
+	catch(const std::out_of_range& e)
+	{
+		std::cerr << "window out of range: limits: [1, 16777216] " << e.what() << std::endl;
+		ret = -1;
+	}
+	return ret;
+}
+
+//Function that checks the simulator seed is an unsigned 64-bit number, decimal or 0x hex
+int checkSeed(std::string &st, uint64_t &seed)
+{
+	int ret = 0;
+	size_t end = 0;
+	try
+	{
+		if(st.empty() || st[0] == '-')
+		{
+			throw std::invalid_argument(st);
+		}
+		seed = std::stoull(st,&end,0);
+		if(end != st.length())
+		{
+			throw std::invalid_argument(st);
+		}
+	}
+	catch(const std::invalid_argument& e)
+	{
+		std::cerr << "Invalid seed: "<< st << std::endl;
+		ret = -1;
+	}
+	catch(const std::out_of_range& e)
+	{
+		std::cerr << "seed out of range: limits: [0, 18446744073709551615] " << e.what() << std::endl;
+		ret = -1;
+	}
+	return ret;
+}
+
 //Usage menu
 void help_menu()
 {
@@ -242,16 +665,25 @@ void help_menu()
 	std::cout << "**********************************************************" << std::endl;
 	std::cout << "Correct usage: nxp_simtemp_cli [options]"<<std::endl;
 	std::cout << "Options:"<<std::endl;
-	std::cout << "-s\t\tsampling_rate_ms limits: [0.05, 10000]"<<std::endl;
-	std::cout << "-m\t\tmode [d,n,r] (default, noisy, ramp)"<<std::endl;
+	std::cout << "-s\t\tsampling_rate_ms limits: [0.001, 10000]"<<std::endl;
+	std::cout << "-m\t\tmode [d,n,r,p] (default, noisy, ramp, replay)"<<std::endl;
 	std::cout << "-t\t\ttemp_threshold_mC limits: [-50000, 100000]"<<std::endl;
+	std::cout << "-y\t\thysteresis_mC, an alert clears at threshold - hysteresis limits: [0, 150000] (kept as configured when absent)"<<std::endl;
+	std::cout << "-a\t\taccess [r,m] (read, mmap ring)"<<std::endl;
+	std::cout << "-b\t\tsample source [d,s,f] (device, simulator, simulator as fast as possible)"<<std::endl;
+	std::cout << "-r\t\tseed of the simulator sources, random when absent (the device takes it in sysfs seed)"<<std::endl;
+	std::cout << "-d\t\tdevice instance N of /dev/simtempN limits: [0, 63]"<<std::endl;
+	std::cout << "-f\t\ttrace file, one temperature in mC per line, replayed in a loop (sets -mp)"<<std::endl;
+	std::cout << "-c\t\tcompact delta encoded read() format, read access only"<<std::endl;
+	std::cout << "-e\t\tprint alert edges only, signalled with POLLPRI"<<std::endl;
+	std::cout << "-w\t\twindow of N samples summarized by the driver, read access only limits: [1, 16777216]"<<std::endl;
 	std::cout << "-h/--help\tThis help menu"<<std::endl;
 	std::cout << "Example usage: nxp_simtemp_cli -s200 -mr -t20000"<<std::endl;
 	std::cout << "If no options are provided, default parameters will be applied."<<std::endl;
 }
 
 //Funtion that validates and set simulation parameters
-bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, int32_t &threshold_mC)
+bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, int32_t &threshold_mC, int32_t &hysteresis_mC, bool &use_ring, uint32_t &window, bool &events, bool &compact, std::string &wave_path, uint8_t &source_type, uint64_t &seed, bool &seeded)
 {
 	char flag = 0;
 	std::string arg;
@@ -263,7 +695,15 @@ bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, i
 	while(argv[i])
 	{
 		arg = argv[i];
-		if(arg[0]!='-' || arg.length() < 3)
+		if(arg == "-e")
+		{
+			events = true;
+		}
+		else if(arg == "-c")
+		{
+			compact = true;
+		}
+		else if(arg[0]!='-' || arg.length() < 3)
 		{
 			if(arg == "-h")
 			{
@@ -295,7 +735,7 @@ bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, i
 						}
 						else
 						{
-							sampling_us = (uint32_t)(sampling_ms * 1000);
+							sampling_us = (uint32_t)std::lround(sampling_ms * 1000);
 						}
 						break;
 					case 'm':
@@ -310,6 +750,57 @@ bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, i
 							valid_arguments = false;
 						}
 						break;
+					case 'y':
+						if(checkHysteresis(arg_value,hysteresis_mC) == -1)
+						{
+							valid_arguments = false;
+						}
+						break;
+					case 'a':
+						if(arg_value == "r" || arg_value == "m")
+						{
+							use_ring = (arg_value == "m");
+						}
+						else
+						{
+							std::cerr << "Invalid access: " << arg_value << std::endl;
+							valid_arguments = false;
+						}
+						break;
+					case 'd':
+						if(checkDevice(arg_value,dev_index) == -1)
+						{
+							valid_arguments = false;
+						}
+						break;
+					case 'w':
+						if(checkWindow(arg_value,window) == -1)
+						{
+							valid_arguments = false;
+						}
+						break;
+					case 'f':
+						wave_path = arg_value;
+						mode = MODE_RPL;
+						break;
+					case 'r':
+						if(checkSeed(arg_value,seed) == -1)
+						{
+							valid_arguments = false;
+						}
+						seeded = true;
+						break;
+					case 'b':
+						if(arg_value == "d" || arg_value == "s" || arg_value == "f")
+						{
+							source_type = arg_value == "d" ? SOURCE_DEVICE : (arg_value == "s" ? SOURCE_SIM : SOURCE_SIM_FAST);
+						}
+						else
+						{
+							std::cerr << "Invalid source: " << arg_value << std::endl;
+							valid_arguments = false;
+						}
+						break;
 					default:
                         std::cout <<arg<<" : Invalid argument 2"<<std::endl;
 						valid_arguments = false;
@@ -319,12 +810,46 @@ bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, i
 		i++;
 	}
 
+	//The simulator only produces the plain sample stream
+	if(valid_arguments && source_type != SOURCE_DEVICE && (use_ring || compact || events || window != 0 || mode == MODE_RPL))
+	{
+		std::cerr << "The simulator source supports read access of samples only, without -am, -c, -e, -w, -f or -mp" << std::endl;
+		valid_arguments = false;
+	}
+	if(valid_arguments && source_type == SOURCE_DEVICE && seeded)
+	{
+		std::cerr << "-r seeds the simulator sources, write the device seed to " << sysfsPath("seed") << std::endl;
+		valid_arguments = false;
+	}
+
 	if(valid_arguments)
 	{
 		std::cout<<"All arguments are valid"<< std::endl;
 		std::cout << "Sampling rate set: " << sampling_ms << "ms | " << sampling_us << "us" << std::endl;
 		std::cout << "Mode set: " << modes[mode] << std::endl;
 		std::cout << "Temperature threshold set: " << threshold_mC <<" m °C" << std::endl;
+		if(hysteresis_mC >= 0)
+		{
+			std::cout << "Hysteresis set: " << hysteresis_mC <<" m °C" << std::endl;
+		}
+		std::cout << "Access set: " << (use_ring ? "mmap ring" : "read") << std::endl;
+		std::cout << "Device set: " << (source_type == SOURCE_DEVICE ? devicePath() : "simulator") << std::endl;
+		if(window != 0)
+		{
+			std::cout << "Window set: " << window << " samples" << std::endl;
+		}
+		if(events)
+		{
+			std::cout << "Alert edges only" << std::endl;
+		}
+		if(compact)
+		{
+			std::cout << "Compact format" << std::endl;
+		}
+		if(!wave_path.empty())
+		{
+			std::cout << "Trace set: " << wave_path << std::endl;
+		}
 	}
 
 	return valid_arguments;
@@ -11,7 +11,11 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/ioctl.h>
 #include <iomanip>
+#include <cmath>
+#include <fstream>
+#include <vector>
 
 struct simtemp_sample {
 	uint64_t timestamp_ns; //monotonic timestamp
@@ -19,10 +23,144 @@ struct simtemp_sample {
 	uint32_t flags;		//
 }__attribute__((packed));
 
-//Temperature generation modes
+//Record of SIMTEMP_FMT_V2, naturally aligned
+struct simtemp_sample_v2 {
+	uint64_t seq;		//position since insmod, a gap counts the samples lost
+	uint64_t timestamp_ns;	//monotonic timestamp
+	int32_t temp_mC;	//milli-degree Celsius
+	uint32_t flags;		//
+};
+
+//Record formats returned by read(), selected per file, the mmap ring is always V1
+#define SIMTEMP_FMT_V1	1	//struct simtemp_sample, default
+#define SIMTEMP_FMT_V2	2	//struct simtemp_sample_v2
+#define SIMTEMP_FMT_AGG	3	//struct simtemp_agg, one record per closed window
+#define SIMTEMP_FMT_DELTA	4	//struct simtemp_frame headers followed by delta encoded samples
+
+//Header of a SIMTEMP_FMT_DELTA frame, the first sample is stored in full
+struct simtemp_frame {
+	uint64_t seq;			//position of the first sample, a gap to the previous seq + count counts the samples lost
+	uint64_t base_ns;		//timestamp of the first sample
+	uint32_t period_us;		//nominal spacing of the samples
+	int32_t base_mC;		//temperature of the first sample
+	uint32_t flags;		//flags of the first sample
+	uint32_t count;		//samples in the frame
+	uint32_t size;			//payload bytes after the header, the next frame starts at the next multiple of 8
+	uint32_t reserved;
+};
+//Payload, for every sample after the first, LEB128 varints:
+//	zigzag(timestamp_ns - previous timestamp_ns - period_us * 1000) << 1 | flags changed
+//	flags, only if they changed
+//	zigzag(temp_mC - previous temp_mC)
+
+//Summary of a window of SIMTEMP_FMT_AGG, mean = sum_mC / count
+struct simtemp_agg {
+	uint64_t seq;			//position of the first sample, a gap to the previous seq + count counts the samples lost
+	uint64_t start_ns;		//timestamp of the first sample
+	uint64_t end_ns;		//timestamp of the last sample
+	uint32_t count;		//samples in the window
+	uint32_t alerts;		//samples with FLAG_THRESHOLD_CROSSED
+	int32_t min_mC;
+	int32_t max_mC;
+	int64_t sum_mC;
+	uint64_t sum_sq;		//sum of temp_mC squared, variance = sum_sq / count - mean^2
+};
+
+//Alert edges, queued per file and signalled with POLLPRI
+#define SIMTEMP_EVENT_ASSERT	1	//temp_mC went above threshold_mC
+#define SIMTEMP_EVENT_CLEAR		2	//temp_mC went down to threshold_mC - hysteresis_mC
+
+struct simtemp_event {
+	uint64_t seq;			//position of the sample that crossed
+	uint64_t timestamp_ns;	//timestamp of that sample
+	int32_t temp_mC;
+	int32_t threshold_mC;	//threshold crossed, the assert or the clear one
+	uint32_t type;			//SIMTEMP_EVENT_*
+	uint32_t lost;			//edges dropped before this one because the queue was full
+};
+
+//Window of SIMTEMP_FMT_AGG, closed by whichever bound comes first, 0 disables a bound
+struct simtemp_window {
+	uint32_t samples;		//close after this many samples
+	uint32_t time_us;		//close at multiples of this period of the sample timestamps
+};
+
+//Waveform played by the replay mode, uploaded with one write(): this header followed by count int32_t temperatures in mC
+#define SIMTEMP_WAVE_LOOP	(1 << 0)	//restart from the first value, otherwise the last one is held
+#define SIMTEMP_WAVE_MAX	(1 << 20)	//values per waveform
+
+struct simtemp_wave {
+	uint32_t count;		//values that follow, 1 to SIMTEMP_WAVE_MAX
+	uint32_t flags;		//SIMTEMP_WAVE_*
+};
+
+//mmap ring: one control page followed by SIMTEMP_RING_PAGES data pages
+#define SIMTEMP_RING_PAGES	16
+
+struct simtemp_ring_ctrl {
+	uint64_t data_head;	//next index written by the driver
+	uint64_t data_tail;	//next index read by the consumer
+	uint64_t lost;		//samples dropped because the ring was full
+	uint32_t data_offset;	//offset of the sample array from the mapping start
+	uint32_t data_size;	//number of samples in the ring, power of two
+};
+
+//ioctl commands on /dev/simtempN
+#define SIMTEMP_IOC_MAGIC		's'
+#define SIMTEMP_IOC_GET_OVERRUN	_IOR(SIMTEMP_IOC_MAGIC, 1, uint64_t)	//samples this file lost
+#define SIMTEMP_IOC_SET_WAKE	_IOW(SIMTEMP_IOC_MAGIC, 2, struct simtemp_wake)
+#define SIMTEMP_IOC_GET_WAKE	_IOR(SIMTEMP_IOC_MAGIC, 3, struct simtemp_wake)
+#define SIMTEMP_IOC_SET_FORMAT	_IOW(SIMTEMP_IOC_MAGIC, 4, uint32_t)	//SIMTEMP_FMT_*
+#define SIMTEMP_IOC_GET_FORMAT	_IOR(SIMTEMP_IOC_MAGIC, 5, uint32_t)
+#define SIMTEMP_IOC_SET_LOWAT	_IOW(SIMTEMP_IOC_MAGIC, 6, uint32_t)	//poll readiness threshold in samples, sets simtemp_wake.samples
+#define SIMTEMP_IOC_GET_LOWAT	_IOR(SIMTEMP_IOC_MAGIC, 7, uint32_t)
+#define SIMTEMP_IOC_GET_CONFIG	_IOR(SIMTEMP_IOC_MAGIC, 8, struct simtemp_status)
+#define SIMTEMP_IOC_SET_CONFIG	_IOWR(SIMTEMP_IOC_MAGIC, 9, struct simtemp_status)	//returns the applied config and stats
+#define SIMTEMP_IOC_SET_WINDOW	_IOW(SIMTEMP_IOC_MAGIC, 10, struct simtemp_window)	//restarts the open window
+#define SIMTEMP_IOC_GET_WINDOW	_IOR(SIMTEMP_IOC_MAGIC, 11, struct simtemp_window)
+#define SIMTEMP_IOC_GET_EVENT	_IOR(SIMTEMP_IOC_MAGIC, 12, struct simtemp_event)	//oldest queued alert edge, -EAGAIN when none
+
+//Per file wakeup coalescing, samples with FLAG_THRESHOLD_CROSSED always wake
+struct simtemp_wake {
+	uint32_t samples;	//wake once this many samples are queued, 1 wakes on every sample
+	uint32_t latency_us;	//wake anyway once the oldest unread sample is this old, 0 disables it
+	uint32_t adaptive;	//tune samples from the observed drain rate
+};
+
+struct simtemp_flags {
+	uint64_t counter;	//number of samples since insmod
+	uint64_t alert;		//number of alerts since insmod
+	uint64_t overrun;	//samples lost by readers and the mmap ring since insmod
+	uint8_t l_error;	//last error
+}__attribute__((packed));
+
+//Temperature generation modes, value of simtemp_config.mode and of the mode sysfs file
 #define MODE_NRM 0
 #define MODE_NSY 1
 #define MODE_RMP 2
+#define MODE_RPL 3
+
+//Whole configuration of an instance, SIMTEMP_IOC_SET_CONFIG applies it at once
+struct simtemp_config {
+	uint32_t sampling_us;
+	int32_t threshold_mC;
+	uint32_t mode;		//MODE_NRM, MODE_NSY, MODE_RMP or MODE_RPL
+	uint32_t tick_us;
+	uint32_t phase_lock;	//0 free running, 1 locked to multiples of the period
+	uint32_t context;		//0 hardirq, 1 softirq, 2 thread
+	uint32_t hysteresis_mC;	//an alert clears at threshold_mC - hysteresis_mC
+	uint32_t fifo_size;	//read only, resized through sysfs
+};
+
+struct simtemp_status {
+	struct simtemp_config config;
+	struct simtemp_flags stats;
+};
+
+//Sample sources of the CLI
+#define SOURCE_DEVICE 0		// /dev/simtempN
+#define SOURCE_SIM 1		//in-process simulator paced by a timerfd
+#define SOURCE_SIM_FAST 2	//in-process simulator, as fast as possible
  
 //Events flags
 #define FLAG_NEW_SAMPLE (1<<0)
@@ -31,11 +169,27 @@ struct simtemp_sample {
 //Temperature modes names
 extern const char *modes[];
 
+std::string devicePath();
+
+std::string sysfsPath(const char *file);
+
 void getDate(char * date,uint64_t ns);
 
+void printSample(const struct simtemp_sample &sample);
+
+void printRecord(const struct simtemp_sample_v2 &sample, uint64_t &next_seq);
+
+void printWindow(const struct simtemp_agg &agg, uint64_t &next_seq);
+
+void printEvent(const struct simtemp_event &event);
+
+long decodeFrames(const uint8_t *buf, size_t len, struct simtemp_sample_v2 *out, size_t max_out);
+
 int showDefaultSimParameters();
 
-int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_mC);
+int setSimParameters(const uint32_t s_us, const uint8_t mode, const uint32_t t_mC, const int32_t h_mC);
+
+int uploadWave(const std::string &path);
 
 int checkSamplingRate(std::string &st, double &db);
 
@@ -43,8 +197,16 @@ int checkMode(std::string &st, uint8_t &md);
 
 int checkThreshold(std::string &st, int32_t &my_int);
 
+int checkHysteresis(std::string &st, int32_t &my_int);
+
+int checkDevice(std::string &st, unsigned int &index);
+
+int checkWindow(std::string &st, uint32_t &samples);
+
+int checkSeed(std::string &st, uint64_t &seed);
+
 void help_menu();
 
-bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, int32_t &threshold_mC);
+bool argumentsVerification(char* argv[], uint32_t &sampling_us, uint8_t &mode, int32_t &threshold_mC, int32_t &hysteresis_mC, bool &use_ring, uint32_t &window, bool &events, bool &compact, std::string &wave_path, uint8_t &source_type, uint64_t &seed, bool &seeded);
 
 #endif
\ No newline at end of file
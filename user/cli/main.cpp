@@ -1,6 +1,18 @@
+#include <memory>
 #include "lib.h"
+#include "ring.h"
+#include "source.h"
 
-static struct simtemp_sample current_sample;
+//Samples fetched per read(), the driver returns as many as are queued
+#define SAMPLE_BATCH 64
+
+static struct simtemp_sample_v2 samples[SAMPLE_BATCH];
+static struct simtemp_agg windows[SAMPLE_BATCH];
+
+//Delta encoded frames of one read() and their decoded samples, a sample takes at least 2 bytes
+#define FRAME_BUFFER 8192
+alignas(8) static uint8_t frames[FRAME_BUFFER];
+static struct simtemp_sample_v2 decoded[FRAME_BUFFER / 2];
 
 
 int main(int argc, char* argv[])
@@ -8,18 +20,34 @@ int main(int argc, char* argv[])
 	bool poll_dev = true;
 	uint32_t sampling_us = 120000;
 	int32_t threshold_mC = 25000;
+	int32_t hysteresis_mC = -1;	//kept as configured unless -y
 	uint8_t mode = MODE_NRM;
+	bool use_ring = false;
+	uint32_t window = 0;
+	bool events = false;
+	bool compact = false;
+	std::string wave_path;
+	uint8_t source_type = SOURCE_DEVICE;
+	uint64_t seed = 0;
+	bool seeded = false;
+	std::unique_ptr<SampleSource> source;
+	DeviceSource *device = NULL;
+	struct simtemp_event event;
+	struct simtemp_window agg_window;
 	
 	
 	int fd = 0;
-	char date[128] = {0};
+	uint32_t format = SIMTEMP_FMT_V2;
+	uint64_t next_seq = 0;
 	struct pollfd pfd;
+	SampleRing ring;
 	
 	if(argc>1)
 	{	
-		if(argumentsVerification(argv,sampling_us,mode,threshold_mC))
+		if(argumentsVerification(argv,sampling_us,mode,threshold_mC,hysteresis_mC,use_ring,window,events,compact,wave_path,source_type,seed,seeded))
 		{
-			if (setSimParameters(sampling_us,mode,threshold_mC) != 0)
+			//Uploaded before the mode switch, so playback starts from the first value
+			if(!wave_path.empty() && uploadWave(wave_path) != 0)
 			{
 				poll_dev = false;
 			}
@@ -38,16 +66,141 @@ int main(int argc, char* argv[])
 	}
 	if(poll_dev)
 	{
-		fd = open("/dev/simtemp",O_RDONLY);
-		if(fd<0)
+		//The driver, or its simulation on machines without the module
+		if(source_type == SOURCE_DEVICE)
+		{
+			device = new DeviceSource(use_ring);
+			source.reset(device);
+		}
+		else
+		{
+			source.reset(new SimSource(source_type == SOURCE_SIM_FAST,seeded,seed));
+		}
+		if(argc > 1 && source->configure(sampling_us,mode,threshold_mC,hysteresis_mC) != 0)
+		{
+			return 1;
+		}
+		if(source->open() != 0)
+		{
+			return 1;
+		}
+		//Ring, formats, windows and edges are driver features, argumentsVerification() keeps them off the simulator
+		fd = device ? device->fd() : -1;
+		if(use_ring && ring.map(fd) != 0)
 		{
-			std::cout << "Cannot open device file... "<< errno <<" (" << strerror(errno) << ") " << std::endl;
 			return 1;
 		}
+		//Several samples per 16-byte record
+		if(!use_ring && compact)
+		{
+			format = SIMTEMP_FMT_DELTA;
+			if(ioctl(fd,SIMTEMP_IOC_SET_FORMAT,&format) != 0)
+			{
+				perror("SIMTEMP_IOC_SET_FORMAT");
+				return 1;
+			}
+		}
+		//Only one summary per window crosses to userspace
+		if(!use_ring && window != 0)
+		{
+			agg_window.samples = window;
+			agg_window.time_us = 0;
+			format = SIMTEMP_FMT_AGG;
+			if(ioctl(fd,SIMTEMP_IOC_SET_WINDOW,&agg_window) != 0 || ioctl(fd,SIMTEMP_IOC_SET_FORMAT,&format) != 0)
+			{
+				perror("SIMTEMP_IOC_SET_WINDOW");
+				return 1;
+			}
+		}
 		pfd.fd = fd;
-		pfd.events = POLLIN;
+		pfd.events = events ? POLLPRI : POLLIN;
 		while(1)
 		{
+			if(events)
+			{
+				//Sleep until an alert edge, the sample stream is never read
+				while(ioctl(fd,SIMTEMP_IOC_GET_EVENT,&event) == 0)
+				{
+					printEvent(event);
+				}
+				std::cout << std::flush;
+				if(errno != EAGAIN)
+				{
+					perror("SIMTEMP_IOC_GET_EVENT");
+					break;
+				}
+				if(poll(&pfd,1,-1) == -1)
+				{
+					perror("Error during poll");
+					break;
+				}
+				if(pfd.revents & (POLLERR | POLLHUP))
+				{
+					std::cout << "Device removed." << std::endl;
+					break;
+				}
+				continue;
+			}
+			if(!use_ring && compact && window == 0)
+			{
+				ssize_t bytes_read = read(fd,frames,sizeof(frames));
+				if(bytes_read < 0)
+				{
+					perror("Error during read");
+					break;
+				}
+				long n_samples = decodeFrames(frames,bytes_read,decoded,FRAME_BUFFER / 2);
+				if(n_samples < 0)
+				{
+					std::cerr << "Malformed frame" << std::endl;
+					break;
+				}
+				for(long i = 0; i < n_samples; i++)
+				{
+					printRecord(decoded[i],next_seq);
+				}
+				std::cout << std::flush;
+				continue;
+			}
+			if(!use_ring && window != 0)
+			{
+				//read() sleeps until the driver closes a window
+				ssize_t bytes_read = read(fd,windows,sizeof(windows));
+				if(bytes_read < 0)
+				{
+					perror("Error during read");
+					break;
+				}
+				size_t n_windows = bytes_read / sizeof(struct simtemp_agg);
+				for(size_t i = 0; i < n_windows; i++)
+				{
+					printWindow(windows[i],next_seq);
+				}
+				std::cout << std::flush;
+				continue;
+			}
+			if(!use_ring)
+			{
+				ssize_t n_samples = source->read(samples,SAMPLE_BATCH);
+				if(n_samples < 0)
+				{
+					break;
+				}
+				for(ssize_t i = 0; i < n_samples; i++)
+				{
+					printRecord(samples[i],next_seq);
+				}
+				std::cout << std::flush;
+				continue;
+			}
+			
+			//Drain the ring without syscalls, poll only once it is empty
+			if(ring.drain(printSample) != 0)
+			{
+				std::cout << std::flush;
+				continue;
+			}
+			
 			int ret = poll(&pfd,1,5000);
 			if(ret == -1)
 			{
@@ -59,15 +212,10 @@ int main(int argc, char* argv[])
 				std::cout << "Timeout waiting for data." << std::endl;
 				continue;
 			}
-			
-			if(pfd.revents & POLLIN)
+			if(pfd.revents & (POLLERR | POLLHUP))
 			{
-				if (read(fd,&current_sample,sizeof(current_sample)) == sizeof(current_sample))
-				{
-					getDate(date,current_sample.timestamp_ns);
-					
-					std::cout << date << " temp=" << std::fixed << std::setprecision(1) <<(double)current_sample.temp_mC/1000 << "C alert=" << (current_sample.flags & FLAG_THRESHOLD_CROSSED ? "1":"0") << std::endl;
-				}
+				std::cout << "Device removed." << std::endl;
+				break;
 			}
 		} 
 	}
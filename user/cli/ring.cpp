@@ -0,0 +1,43 @@
+#include "ring.h"
+
+SampleRing::SampleRing() : base(MAP_FAILED), length(0), ctrl(NULL), data(NULL), mask(0)
+{
+}
+
+SampleRing::~SampleRing()
+{
+	unmap();
+}
+
+//Function that maps the control page and the data pages of the ring
+int SampleRing::map(int fd)
+{
+	length = (1 + SIMTEMP_RING_PAGES) * sysconf(_SC_PAGESIZE);
+
+	base = mmap(NULL,length,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+	if(base == MAP_FAILED)
+	{
+		perror("mmap ring");
+		return -1;
+	}
+
+	ctrl = static_cast<struct simtemp_ring_ctrl *>(base);
+	data = reinterpret_cast<const struct simtemp_sample *>(static_cast<uint8_t *>(base) + ctrl->data_offset);
+	mask = ctrl->data_size - 1;
+
+	return 0;
+}
+
+void SampleRing::unmap()
+{
+	if(base != MAP_FAILED)
+	{
+		munmap(base,length);
+		base = MAP_FAILED;
+	}
+}
+
+uint64_t SampleRing::lost() const
+{
+	return __atomic_load_n(&ctrl->lost,__ATOMIC_RELAXED);
+}
@@ -0,0 +1,47 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <sys/mman.h>
+#include "lib.h"
+
+//Consumer side of the /dev/simtemp mmap ring
+class SampleRing
+{
+public:
+	SampleRing();
+	~SampleRing();
+
+	//Map the ring of an open /dev/simtemp file descriptor
+	int map(int fd);
+	void unmap();
+
+	//Hand every queued sample to handler, returns the number consumed
+	template <typename Handler>
+	size_t drain(Handler handler)
+	{
+		uint64_t head = __atomic_load_n(&ctrl->data_head,__ATOMIC_ACQUIRE);
+		uint64_t tail = ctrl->data_tail;
+		size_t n_samples = head - tail;
+
+		while(tail != head)
+		{
+			handler(data[tail & mask]);
+			tail++;
+		}
+		//Samples are consumed before the driver may reuse their slots
+		__atomic_store_n(&ctrl->data_tail,tail,__ATOMIC_RELEASE);
+
+		return n_samples;
+	}
+
+	uint64_t lost() const;
+
+private:
+	void *base;
+	size_t length;
+	struct simtemp_ring_ctrl *ctrl;
+	const struct simtemp_sample *data;
+	uint64_t mask;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <random>
+#include <time.h>
+#include <sys/timerfd.h>
+#include "source.h"
+
+//Temperature simulation, same values as the driver
+#define TEMP_MEAN_mC 20000
+#define TEMP_MAX 100000
+#define TEMP_MIN -50000
+#define STD_NRM_mC 100 // 0.1 °C
+#define STD_NSY_mC 2000 // 2 °C
+
+DeviceSource::DeviceSource(bool writable) : writable(writable), dev_fd(-1)
+{
+}
+
+DeviceSource::~DeviceSource()
+{
+	if(dev_fd >= 0)
+	{
+		close(dev_fd);
+	}
+}
+
+int DeviceSource::configure(uint32_t sampling_us, uint8_t mode, int32_t threshold_mC, int32_t hysteresis_mC)
+{
+	return setSimParameters(sampling_us,mode,threshold_mC,hysteresis_mC);
+}
+
+int DeviceSource::open()
+{
+	uint32_t format = SIMTEMP_FMT_V2;
+
+	dev_fd = ::open(devicePath().c_str(),writable ? O_RDWR : O_RDONLY);
+	if(dev_fd < 0)
+	{
+		std::cout << "Cannot open device file... "<< errno <<" (" << strerror(errno) << ") " << std::endl;
+		return -1;
+	}
+	//Sequence numbers of the V2 records reveal the samples lost between reads
+	if(ioctl(dev_fd,SIMTEMP_IOC_SET_FORMAT,&format) != 0)
+	{
+		perror("SIMTEMP_IOC_SET_FORMAT");
+		return -1;
+	}
+	return 0;
+}
+
+//read() sleeps until the driver has samples for this file, one syscall per batch
+ssize_t DeviceSource::read(struct simtemp_sample_v2 *out, size_t max_samples)
+{
+	ssize_t bytes_read = ::read(dev_fd,out,max_samples * sizeof(*out));
+
+	if(bytes_read < 0)
+	{
+		perror("Error during read");
+		return -1;
+	}
+	return bytes_read / sizeof(*out);
+}
+
+int DeviceSource::fd() const
+{
+	return dev_fd;
+}
+
+SimSource::SimSource(bool fast, bool seeded, uint64_t seed) : fast(fast), timer_fd(-1), sampling_us(0), mode(MODE_NRM), threshold_mC(0),
+	hysteresis_mC(0), alert_active(false), stddev_mC(STD_NRM_mC), temp_mC(TEMP_MEAN_mC), seq(0), pending(0), next_ns(0)
+{
+	//Random like an instance without a DT seed, printed so a run can be repeated with -r
+	if(!seeded)
+	{
+		std::random_device rd;
+		seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+		std::cout << "Simulator seed: " << seed << std::endl;
+	}
+	gaussian_rng_seed(&rng,seed);
+}
+
+SimSource::~SimSource()
+{
+	if(timer_fd >= 0)
+	{
+		close(timer_fd);
+	}
+}
+
+int SimSource::configure(uint32_t sampling_us, uint8_t mode, int32_t threshold_mC, int32_t hysteresis_mC)
+{
+	if(mode == MODE_RPL)
+	{
+		std::cerr << "The simulator has no replay mode" << std::endl;
+		return -1;
+	}
+	this->sampling_us = sampling_us;
+	this->mode = mode;
+	this->threshold_mC = threshold_mC;
+	//A new simulator starts without hysteresis, as a freshly loaded instance
+	this->hysteresis_mC = hysteresis_mC < 0 ? 0 : hysteresis_mC;
+	//Ramp keeps the last standard deviation, as cfg_set_mode()
+	if(mode == MODE_NRM)
+	{
+		stddev_mC = STD_NRM_mC;
+	}
+	else if(mode == MODE_NSY)
+	{
+		stddev_mC = STD_NSY_mC;
+	}
+	return 0;
+}
+
+int SimSource::open()
+{
+	struct timespec now;
+	struct itimerspec period;
+
+	clock_gettime(CLOCK_REALTIME,&now);
+	next_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	if(fast)
+	{
+		return 0;
+	}
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC);
+	if(timer_fd < 0)
+	{
+		perror("timerfd_create");
+		return -1;
+	}
+	period.it_interval.tv_sec = sampling_us / 1000000;
+	period.it_interval.tv_nsec = (sampling_us % 1000000) * 1000;
+	period.it_value = period.it_interval;
+	if(timerfd_settime(timer_fd,0,&period,NULL) != 0)
+	{
+		perror("timerfd_settime");
+		return -1;
+	}
+	return 0;
+}
+
+ssize_t SimSource::read(struct simtemp_sample_v2 *out, size_t max_samples)
+{
+	uint64_t step_ns = static_cast<uint64_t>(sampling_us) * 1000;
+	uint64_t expirations = 0;
+	size_t n_samples = max_samples;
+	struct timespec now;
+
+	if(!fast)
+	{
+		//Expiries missed while the consumer was busy come back as one batch, as in the driver
+		if(pending == 0)
+		{
+			if(::read(timer_fd,&expirations,sizeof(expirations)) != sizeof(expirations))
+			{
+				perror("read timerfd");
+				return -1;
+			}
+			pending = expirations;
+		}
+		n_samples = std::min<uint64_t>(pending,max_samples);
+		pending -= n_samples;
+
+		//The newest sample is stamped now, the others one period apart before it
+		clock_gettime(CLOCK_REALTIME,&now);
+		next_ns = now.tv_sec * 1000000000ULL + now.tv_nsec - (n_samples - 1) * step_ns;
+	}
+
+	for(size_t i = 0; i < n_samples; i++)
+	{
+		generate(out[i],next_ns);
+		next_ns += step_ns;
+	}
+	return n_samples;
+}
+
+//Port of simtemp_generate(), one gaussian draw per normal or noisy sample
+void SimSource::generate(struct simtemp_sample_v2 &sample, uint64_t timestamp_ns)
+{
+	if(mode == MODE_NRM || mode == MODE_NSY)
+	{
+		temp_mC = gaussian_s32_icdf_rng(&rng,TEMP_MEAN_mC,stddev_mC);
+	}
+	else
+	{
+		temp_mC = ((temp_mC + 1000 - TEMP_MIN) % (TEMP_MAX - TEMP_MIN + 1)) + TEMP_MIN;
+	}
+	sample.seq = seq++;
+	sample.timestamp_ns = timestamp_ns;
+	sample.temp_mC = temp_mC;
+	sample.flags = FLAG_NEW_SAMPLE;
+
+	//Asserted above threshold_mC, cleared only at or below threshold_mC - hysteresis_mC
+	if(alert_active)
+	{
+		alert_active = temp_mC > threshold_mC - hysteresis_mC;
+	}
+	else
+	{
+		alert_active = temp_mC > threshold_mC;
+	}
+	if(alert_active)
+	{
+		sample.flags |= FLAG_THRESHOLD_CROSSED;
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include "lib.h"
+
+//Generator of kernel/gaussian_random.c, built against the shim headers of user/bench
+extern "C" {
+#include "gaussian_random.h"
+}
+
+//Producer of the V2 records the CLI prints: the driver or an in-process simulation of it
+class SampleSource
+{
+public:
+	virtual ~SampleSource() {}
+
+	//Apply the simulation parameters, before open(), a negative hysteresis_mC keeps the configured one
+	virtual int configure(uint32_t sampling_us, uint8_t mode, int32_t threshold_mC, int32_t hysteresis_mC) = 0;
+	virtual int open() = 0;
+
+	//Block until samples are available, returns the number of records stored or -1
+	virtual ssize_t read(struct simtemp_sample_v2 *out, size_t max_samples) = 0;
+};
+
+//Samples of /dev/simtempN, read() in SIMTEMP_FMT_V2
+class DeviceSource : public SampleSource
+{
+public:
+	//The mmap ring consumer writes data_tail, so it needs a writable file
+	explicit DeviceSource(bool writable);
+	~DeviceSource();
+
+	int configure(uint32_t sampling_us, uint8_t mode, int32_t threshold_mC, int32_t hysteresis_mC);
+	int open();
+	ssize_t read(struct simtemp_sample_v2 *out, size_t max_samples);
+
+	//File descriptor for the driver only features: mmap ring, formats, windows and edges
+	int fd() const;
+
+private:
+	bool writable;
+	int dev_fd;
+};
+
+//The driver producer ported to userspace: same generators, ramp and alert flag, no module needed
+class SimSource : public SampleSource
+{
+public:
+	//Paced by a timerfd at sampling_us, or as fast as possible with timestamps sampling_us apart
+	//Without a seed one is drawn and printed, so the run can be repeated
+	SimSource(bool fast, bool seeded, uint64_t seed);
+	~SimSource();
+
+	int configure(uint32_t sampling_us, uint8_t mode, int32_t threshold_mC, int32_t hysteresis_mC);
+	int open();
+	ssize_t read(struct simtemp_sample_v2 *out, size_t max_samples);
+
+private:
+	void generate(struct simtemp_sample_v2 &sample, uint64_t timestamp_ns);
+
+	bool fast;
+	int timer_fd;
+	uint32_t sampling_us;
+	uint8_t mode;
+	int32_t threshold_mC;
+	int32_t hysteresis_mC;
+	bool alert_active;		//alert state with hysteresis, as the driver
+	uint32_t stddev_mC;
+	int32_t temp_mC;		//last sample, the ramp continues from it
+	uint64_t seq;
+	uint64_t pending;		//expiries not turned into samples yet
+	uint64_t next_ns;		//timestamp of the next sample when fast
+	struct gaussian_rng rng;
+};
+
+#endif